@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+
+// Read-only view of a contiguous array owned by someone else
+template <typename T>
+class ArrayView {
+public:
+    ArrayView() = default;
+
+    ArrayView(const T* data, size_t size)
+        : data_(data)
+        , size_(size) {
+    }
+
+    const T* begin() const {
+        return data_;
+    }
+
+    const T* end() const {
+        return data_ + size_;
+    }
+
+    const T* data() const {
+        return data_;
+    }
+
+    size_t size() const {
+        return size_;
+    }
+
+    bool empty() const {
+        return size_ == 0;
+    }
+
+    const T& operator[](size_t index) const {
+        return data_[index];
+    }
+
+    const T& back() const {
+        return data_[size_ - 1];
+    }
+
+private:
+    const T* data_ = nullptr;
+    size_t size_ = 0;
+};
\ No newline at end of file
@@ -3,6 +3,8 @@
 #include <string>
 #include <iostream>
 #include <cmath>
+#include <limits>
+#include <optional>
 
 struct Document {
     Document();
@@ -21,6 +23,15 @@ enum class DocumentStatus {
     REMOVED,
 };
 
+// Condition on document fields that FindTopDocuments applies without calling a predicate
+// per posting. Segments keep their documents ordered by status, so a status filter only
+// reads the postings of documents with that status.
+struct DocumentFilter {
+    std::optional<DocumentStatus> status;
+    int min_rating = std::numeric_limits<int>::min();
+    int max_rating = std::numeric_limits<int>::max();
+};
+
 std::ostream& operator<<(std::ostream& out, const Document& document);
 
 bool operator==(const Document& lhs, const Document& rhs);
\ No newline at end of file
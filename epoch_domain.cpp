@@ -0,0 +1,89 @@
+#include "epoch_domain.h"
+
+#include <algorithm>
+#include <limits>
+
+// Slots are never freed: a thread that exits gives its slot back for reuse
+struct EpochDomain::ThreadSlot {
+    std::atomic<uint64_t> epoch{ 0 };   // 0 while the thread holds no guard
+    std::atomic<bool> in_use{ true };
+    size_t depth = 0;                   // only touched by the owning thread
+    ThreadSlot* next = nullptr;
+};
+
+EpochDomain::Guard::Guard()
+    : slot_(&GetDefault().GetThreadSlot())
+{
+    // Nested guards are covered by the outermost one, which entered at an earlier epoch
+    if (slot_->depth++ == 0) {
+        slot_->epoch.store(GetDefault().epoch_.load());
+    }
+}
+
+EpochDomain::Guard::~Guard() {
+    if (--slot_->depth == 0) {
+        slot_->epoch.store(0, std::memory_order_release);
+    }
+}
+
+void EpochDomain::Reclaim() {
+    std::lock_guard guard(retired_mutex_);
+    uint64_t min_epoch = std::numeric_limits<uint64_t>::max();
+    for (const ThreadSlot* slot = slots_.load(); slot != nullptr; slot = slot->next) {
+        const uint64_t epoch = slot->epoch.load();
+        if (epoch != 0) {
+            min_epoch = std::min(min_epoch, epoch);
+        }
+    }
+    // A reader that entered after an object was retired cannot have reached it
+    const auto reachable_end = std::partition(retired_.begin(), retired_.end(), [min_epoch](const Retired& retired) {
+        return retired.epoch >= min_epoch;
+        });
+    for (auto it = reachable_end; it != retired_.end(); ++it) {
+        it->deleter(it->object);
+    }
+    retired_.erase(reachable_end, retired_.end());
+}
+
+EpochDomain& EpochDomain::GetDefault() {
+    static EpochDomain* domain = new EpochDomain();
+    return *domain;
+}
+
+void EpochDomain::Retire(const void* object, void (*deleter)(const void*)) {
+    {
+        std::lock_guard guard(retired_mutex_);
+        retired_.push_back({ epoch_.fetch_add(1), object, deleter });
+    }
+    Reclaim();
+}
+
+EpochDomain::ThreadSlot& EpochDomain::GetThreadSlot() {
+    struct SlotOwner {
+        ThreadSlot* slot = nullptr;
+
+        ~SlotOwner() {
+            if (slot != nullptr) {
+                slot->in_use.store(false, std::memory_order_release);
+            }
+        }
+    };
+    thread_local SlotOwner owner;
+    if (owner.slot != nullptr) {
+        return *owner.slot;
+    }
+
+    for (ThreadSlot* slot = slots_.load(); slot != nullptr; slot = slot->next) {
+        bool in_use = false;
+        if (slot->in_use.compare_exchange_strong(in_use, true)) {
+            owner.slot = slot;
+            return *slot;
+        }
+    }
+    auto* slot = new ThreadSlot();
+    slot->next = slots_.load();
+    while (!slots_.compare_exchange_weak(slot->next, slot)) {
+    }
+    owner.slot = slot;
+    return *slot;
+}
\ No newline at end of file
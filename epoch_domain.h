@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// Epoch-based reclamation for objects that readers use without locking. A reader holds a
+// Guard while it touches shared objects; a writer first unlinks an object so that new
+// readers cannot reach it, then retires it. Retired objects are deleted once every guard
+// that was entered before the retirement has been left. Guards never block and may nest.
+class EpochDomain {
+    struct ThreadSlot;
+
+public:
+    class Guard {
+    public:
+        Guard();
+
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+
+        ~Guard();
+
+    private:
+        ThreadSlot* slot_;
+    };
+
+    EpochDomain(const EpochDomain&) = delete;
+    EpochDomain& operator=(const EpochDomain&) = delete;
+
+    template <typename T>
+    void Retire(const T* object) {
+        Retire(object, [](const void* pointer) { delete static_cast<const T*>(pointer); });
+    }
+
+    // Deletes the retired objects no reader can reach anymore
+    void Reclaim();
+
+    // The domain lives until the process exits, so guards may be taken on any thread at any time
+    static EpochDomain& GetDefault();
+
+private:
+    struct Retired {
+        uint64_t epoch;
+        const void* object;
+        void (*deleter)(const void*);
+    };
+
+    std::atomic<uint64_t> epoch_{ 1 };
+    std::atomic<ThreadSlot*> slots_{ nullptr };
+    std::mutex retired_mutex_;
+    std::vector<Retired> retired_;
+
+    EpochDomain() = default;
+
+    void Retire(const void* object, void (*deleter)(const void*));
+
+    // Returns the calling thread's slot, registering the thread on first use
+    ThreadSlot& GetThreadSlot();
+};
\ No newline at end of file
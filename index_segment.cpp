@@ -0,0 +1,220 @@
+#include "index_segment.h"
+
+#include <algorithm>
+
+void DocumentColumns::resize(size_t size) {
+    ids.resize(size);
+    ratings.resize(size);
+    statuses.resize(size);
+    inv_word_counts.resize(size);
+    word_frequencies.resize(size);
+}
+
+void DocumentColumns::Append(const DocumentColumns& other, size_t index) {
+    ids.push_back(other.ids[index]);
+    ratings.push_back(other.ratings[index]);
+    statuses.push_back(other.statuses[index]);
+    inv_word_counts.push_back(other.inv_word_counts[index]);
+    word_frequencies.push_back(other.word_frequencies[index]);
+}
+
+IndexSegment::IndexSegment(uint32_t first_ordinal, DocumentColumns documents, std::vector<TermId> term_ids, std::vector<PostingList> postings,
+    std::vector<PositionList> positions)
+    : first_ordinal_(first_ordinal)
+    , documents_(std::move(documents))
+    , term_ids_(std::move(term_ids))
+    , postings_(std::move(postings))
+    , positions_(std::move(positions))
+{
+    for (size_t status = 0; status < STATUS_COUNT; ++status) {
+        const auto begin = std::lower_bound(documents_.statuses.begin(), documents_.statuses.end(), static_cast<DocumentStatus>(status));
+        status_begins_[status] = first_ordinal_ + static_cast<uint32_t>(begin - documents_.statuses.begin());
+    }
+    status_begins_[STATUS_COUNT] = GetEndOrdinal();
+    ordinals_by_id_.reserve(documents_.size());
+    for (uint32_t i = 0; i < documents_.size(); ++i) {
+        ordinals_by_id_.emplace_back(documents_.ids[i], first_ordinal_ + i);
+    }
+    std::sort(ordinals_by_id_.begin(), ordinals_by_id_.end());
+}
+
+size_t IndexSegment::FindTerm(TermId term_id) const {
+    const auto it = std::lower_bound(term_ids_.begin(), term_ids_.end(), term_id);
+    return it == term_ids_.end() || *it != term_id ? NO_TERM_INDEX : static_cast<size_t>(it - term_ids_.begin());
+}
+
+const PostingList* IndexSegment::FindPostings(TermId term_id) const {
+    const size_t term_index = FindTerm(term_id);
+    return term_index == NO_TERM_INDEX ? nullptr : &postings_[term_index];
+}
+
+SegmentDeletions::SegmentDeletions(size_t segment_size) {
+    static const auto empty_chunk = std::make_shared<const Chunk>(Chunk{});
+    chunks.assign((segment_size + CHUNK_SIZE - 1) / CHUNK_SIZE, empty_chunk);
+}
+
+void SegmentDeletions::Add(std::vector<size_t> document_indexes) {
+    std::sort(document_indexes.begin(), document_indexes.end());
+    for (size_t begin = 0; begin < document_indexes.size();) {
+        const size_t chunk_index = document_indexes[begin] / CHUNK_SIZE;
+        auto chunk = std::make_shared<Chunk>(*chunks[chunk_index]);
+        for (; begin < document_indexes.size() && document_indexes[begin] / CHUNK_SIZE == chunk_index; ++begin) {
+            const size_t bit = document_indexes[begin] % CHUNK_SIZE;
+            (*chunk)[bit / 64] |= uint64_t{ 1 } << (bit % 64);
+            ++document_count;
+        }
+        chunks[chunk_index] = std::move(chunk);
+    }
+}
+
+size_t IndexPart::GetLiveDocumentCount() const {
+    return segment->GetDocumentCount() - (deletions ? deletions->document_count : 0);
+}
+
+std::optional<uint32_t> IndexPart::FindDocument(int document_id) const {
+    // A removed document may share its id with a live one added later
+    const auto& ordinals = segment->GetOrdinalsById();
+    auto it = std::lower_bound(ordinals.begin(), ordinals.end(), std::pair<int, uint32_t>(document_id, 0));
+    for (; it != ordinals.end() && it->first == document_id; ++it) {
+        if (!IsDeleted(it->second)) {
+            return it->second;
+        }
+    }
+    return std::nullopt;
+}
+
+IndexPart IndexPart::WithDeletedDocuments(const std::vector<uint32_t>& ordinals, const TermDictionary& terms,
+    std::vector<std::pair<TermId, int64_t>>* document_freq_changes) const {
+    auto result = deletions
+        ? std::make_shared<SegmentDeletions>(*deletions)
+        : std::make_shared<SegmentDeletions>(segment->GetDocumentCount());
+    std::vector<size_t> document_indexes;
+    document_indexes.reserve(ordinals.size());
+    for (uint32_t ordinal : ordinals) {
+        document_indexes.push_back(ordinal - segment->GetFirstOrdinal());
+        if (document_freq_changes == nullptr) {
+            continue;
+        }
+        for (const auto& [word, term_freq] : segment->GetWordFrequencies(ordinal)) {
+            const TermId term_id = terms.Find(word);
+            if (segment->FindTerm(term_id) != IndexSegment::NO_TERM_INDEX) {
+                document_freq_changes->emplace_back(term_id, -1);
+            }
+        }
+    }
+    result->Add(std::move(document_indexes));
+    return { segment, std::move(result) };
+}
+
+DocumentFreqTable DocumentFreqTable::WithChanges(std::vector<std::pair<TermId, int64_t>> changes) const {
+    if (changes.empty()) {
+        return *this;
+    }
+    std::sort(changes.begin(), changes.end());
+    static const auto empty_chunk = std::make_shared<const Chunk>(Chunk{});
+    auto chunks = chunks_
+        ? std::make_shared<std::vector<std::shared_ptr<const Chunk>>>(*chunks_)
+        : std::make_shared<std::vector<std::shared_ptr<const Chunk>>>();
+    const size_t chunk_count = changes.back().first / CHUNK_SIZE + 1;
+    if (chunks->size() < chunk_count) {
+        chunks->resize(chunk_count, empty_chunk);
+    }
+    for (size_t begin = 0; begin < changes.size();) {
+        const size_t chunk_index = changes[begin].first / CHUNK_SIZE;
+        auto chunk = std::make_shared<Chunk>(*(*chunks)[chunk_index]);
+        for (; begin < changes.size() && changes[begin].first / CHUNK_SIZE == chunk_index; ++begin) {
+            uint32_t& document_freq = (*chunk)[changes[begin].first % CHUNK_SIZE];
+            document_freq = static_cast<uint32_t>(document_freq + changes[begin].second);
+        }
+        (*chunks)[chunk_index] = std::move(chunk);
+    }
+    DocumentFreqTable result;
+    result.chunks_ = std::move(chunks);
+    return result;
+}
+
+std::shared_ptr<const IndexSegment> MergeSegments(ArrayView<IndexPart> parts, uint32_t first_ordinal) {
+    DocumentColumns documents;
+    std::vector<std::vector<uint32_t>> new_ordinals(parts.size());
+    std::vector<TermId> term_ids;
+    bool has_positions = true;
+    for (size_t i = 0; i < parts.size(); ++i) {
+        const IndexSegment& segment = *parts[i].segment;
+        new_ordinals[i].resize(segment.GetDocumentCount());
+        term_ids.insert(term_ids.end(), segment.GetTermIds().begin(), segment.GetTermIds().end());
+        has_positions = has_positions && segment.HasPositions();
+    }
+    for (size_t status = 0; status < IndexSegment::STATUS_COUNT; ++status) {
+        for (size_t i = 0; i < parts.size(); ++i) {
+            const IndexSegment& segment = *parts[i].segment;
+            const auto [range_begin, range_end] = segment.GetStatusRange(static_cast<DocumentStatus>(status));
+            for (uint32_t ordinal = range_begin; ordinal < range_end; ++ordinal) {
+                if (!parts[i].IsDeleted(ordinal)) {
+                    new_ordinals[i][ordinal - segment.GetFirstOrdinal()] = first_ordinal + static_cast<uint32_t>(documents.size());
+                    documents.Append(segment.GetDocuments(), ordinal - segment.GetFirstOrdinal());
+                }
+            }
+        }
+    }
+    std::sort(term_ids.begin(), term_ids.end());
+    term_ids.erase(std::unique(term_ids.begin(), term_ids.end()), term_ids.end());
+
+    // Term frequencies are recomputed from the documents, so block bounds stay exact
+    std::vector<TermId> merged_term_ids;
+    std::vector<PostingList> merged_postings;
+    std::vector<PositionList> merged_positions;
+    std::pmr::vector<uint32_t> positions;
+    std::vector<size_t> term_indexes(parts.size());
+    for (TermId term_id : term_ids) {
+        PostingList merged;
+        PositionList merged_term_positions;
+        for (size_t i = 0; i < parts.size(); ++i) {
+            term_indexes[i] = parts[i].segment->FindTerm(term_id);
+        }
+        // Each status is a run of every input list, so the runs are appended in the new document order
+        for (size_t status = 0; status < IndexSegment::STATUS_COUNT; ++status) {
+            for (size_t i = 0; i < parts.size(); ++i) {
+                const IndexSegment& segment = *parts[i].segment;
+                const size_t term_index = term_indexes[i];
+                if (term_index == IndexSegment::NO_TERM_INDEX) {
+                    continue;
+                }
+                const auto [range_begin, range_end] = segment.GetStatusRange(static_cast<DocumentStatus>(status));
+                auto cursor = segment.GetPostings(term_index).GetCursor();
+                cursor.SkipTo(range_begin);
+                if (cursor.IsEnd() || cursor.GetOrdinal() >= range_end) {
+                    continue;
+                }
+                std::optional<PositionList::Cursor> positions_cursor;
+                if (has_positions) {
+                    positions_cursor.emplace(segment.GetPositions(term_index), cursor.GetIndex());
+                }
+                for (; !cursor.IsEnd() && cursor.GetOrdinal() < range_end; cursor.Next()) {
+                    const uint32_t ordinal = cursor.GetOrdinal();
+                    if (positions_cursor) {
+                        positions_cursor->Read(positions);
+                    }
+                    if (parts[i].IsDeleted(ordinal)) {
+                        continue;
+                    }
+                    merged.Append(new_ordinals[i][ordinal - segment.GetFirstOrdinal()], cursor.GetCount(),
+                        cursor.GetCount() * segment.GetInvWordCounts()[ordinal - segment.GetFirstOrdinal()]);
+                    if (positions_cursor) {
+                        merged_term_positions.Append(positions.data(), positions.size());
+                    }
+                }
+            }
+        }
+        if (!merged.empty()) {
+            merged.ShrinkToFit();
+            merged_term_ids.push_back(term_id);
+            merged_postings.push_back(std::move(merged));
+            if (has_positions) {
+                merged_term_positions.ShrinkToFit();
+                merged_positions.push_back(std::move(merged_term_positions));
+            }
+        }
+    }
+    return std::make_shared<const IndexSegment>(first_ordinal, std::move(documents), std::move(merged_term_ids), std::move(merged_postings),
+        std::move(merged_positions));
+}
\ No newline at end of file
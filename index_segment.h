@@ -0,0 +1,201 @@
+#pragma once
+
+#include "array_view.h"
+#include "document.h"
+#include "position_list.h"
+#include "posting_list.h"
+#include "term_dictionary.h"
+
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+using WordFrequencies = std::map<std::string_view, double>;
+
+// Per-document data of a segment as dense columns indexed by ordinal - first ordinal.
+// Word frequency maps key into the term dictionary's arena; merged segments share them
+// with their inputs.
+struct DocumentColumns {
+    std::vector<int> ids;
+    std::vector<int> ratings;
+    std::vector<DocumentStatus> statuses;
+    std::vector<double> inv_word_counts;
+    std::vector<std::shared_ptr<const WordFrequencies>> word_frequencies;
+
+    size_t size() const {
+        return ids.size();
+    }
+
+    void resize(size_t size);
+
+    // Appends document number index of other
+    void Append(const DocumentColumns& other, size_t index);
+};
+
+// Immutable piece of the index holding the documents with consecutive ordinals from
+// GetFirstOrdinal(). Documents are ordered by status, so the documents with one status
+// have a range of ordinals and their postings are a run of every posting list. Posting
+// lists use the same global ordinals and are kept only for terms that occur in the segment,
+// sorted by term id. With the positional index, every posting list has a position list next to it.
+class IndexSegment {
+public:
+    static constexpr size_t NO_TERM_INDEX = std::numeric_limits<size_t>::max();
+    static constexpr size_t STATUS_COUNT = static_cast<size_t>(DocumentStatus::REMOVED) + 1;
+
+    IndexSegment(uint32_t first_ordinal, DocumentColumns documents, std::vector<TermId> term_ids, std::vector<PostingList> postings,
+        std::vector<PositionList> positions = {});
+
+    uint32_t GetFirstOrdinal() const {
+        return first_ordinal_;
+    }
+
+    uint32_t GetEndOrdinal() const {
+        return first_ordinal_ + static_cast<uint32_t>(documents_.size());
+    }
+
+    size_t GetDocumentCount() const {
+        return documents_.size();
+    }
+
+    const DocumentColumns& GetDocuments() const {
+        return documents_;
+    }
+
+    int GetDocumentId(uint32_t ordinal) const {
+        return documents_.ids[ordinal - first_ordinal_];
+    }
+
+    int GetRating(uint32_t ordinal) const {
+        return documents_.ratings[ordinal - first_ordinal_];
+    }
+
+    DocumentStatus GetStatus(uint32_t ordinal) const {
+        return documents_.statuses[ordinal - first_ordinal_];
+    }
+
+    // [begin, end) ordinals of the documents with the given status
+    std::pair<uint32_t, uint32_t> GetStatusRange(DocumentStatus status) const {
+        const size_t index = static_cast<size_t>(status);
+        return { status_begins_[index], status_begins_[index + 1] };
+    }
+
+    // Indexed by ordinal - GetFirstOrdinal(), for scoring whole posting blocks
+    const std::vector<double>& GetInvWordCounts() const {
+        return documents_.inv_word_counts;
+    }
+
+    const WordFrequencies& GetWordFrequencies(uint32_t ordinal) const {
+        return *documents_.word_frequencies[ordinal - first_ordinal_];
+    }
+
+    // (id, ordinal) pairs sorted by id
+    const std::vector<std::pair<int, uint32_t>>& GetOrdinalsById() const {
+        return ordinals_by_id_;
+    }
+
+    const std::vector<TermId>& GetTermIds() const {
+        return term_ids_;
+    }
+
+    // Returns the index of the term among GetTermIds(), or NO_TERM_INDEX
+    size_t FindTerm(TermId term_id) const;
+
+    const PostingList& GetPostings(size_t term_index) const {
+        return postings_[term_index];
+    }
+
+    // Returns nullptr if the term does not occur in the segment
+    const PostingList* FindPostings(TermId term_id) const;
+
+    bool HasPositions() const {
+        return positions_.size() == postings_.size();
+    }
+
+    // Only for segments with positions
+    const PositionList& GetPositions(size_t term_index) const {
+        return positions_[term_index];
+    }
+
+private:
+    uint32_t first_ordinal_;
+    DocumentColumns documents_;
+    std::array<uint32_t, STATUS_COUNT + 1> status_begins_;
+    std::vector<std::pair<int, uint32_t>> ordinals_by_id_;
+    std::vector<TermId> term_ids_;
+    std::vector<PostingList> postings_;
+    std::vector<PositionList> positions_;
+};
+
+// Documents removed from a segment after it was built. The bitmap is split into chunks
+// shared between versions, so removing documents copies only the chunks they fall in.
+struct SegmentDeletions {
+    static constexpr size_t CHUNK_SIZE = 4096;
+
+    using Chunk = std::array<uint64_t, CHUNK_SIZE / 64>;
+
+    std::vector<std::shared_ptr<const Chunk>> chunks;
+    size_t document_count = 0;
+
+    // No documents of a segment with segment_size documents are removed
+    explicit SegmentDeletions(size_t segment_size);
+
+    bool Contains(size_t document_index) const {
+        return (*chunks[document_index / CHUNK_SIZE])[document_index % CHUNK_SIZE / 64] >> (document_index % 64) & 1;
+    }
+
+    // Marks the documents, which must not be removed yet, as removed
+    void Add(std::vector<size_t> document_indexes);
+};
+
+// Segment as seen by one index version
+struct IndexPart {
+    std::shared_ptr<const IndexSegment> segment;
+    std::shared_ptr<const SegmentDeletions> deletions;
+
+    bool IsDeleted(uint32_t ordinal) const {
+        return deletions && deletions->Contains(ordinal - segment->GetFirstOrdinal());
+    }
+
+    size_t GetLiveDocumentCount() const;
+
+    // Returns the ordinal of the live document with the given id
+    std::optional<uint32_t> FindDocument(int document_id) const;
+
+    // Returns a copy of the part with the given live documents removed. Each touched bitmap
+    // chunk is copied once however many of its documents go.
+    // If document_freq_changes is given, a (term id, -1) pair is added to it per removed posting.
+    IndexPart WithDeletedDocuments(const std::vector<uint32_t>& ordinals, const TermDictionary& terms,
+        std::vector<std::pair<TermId, int64_t>>* document_freq_changes = nullptr) const;
+};
+
+// Number of live documents containing each term, for all segments of an index version.
+// The table is split into chunks shared between versions, so a change copies only the
+// chunks of the terms it touches and the list of chunks. Copying the table copies neither.
+class DocumentFreqTable {
+public:
+    size_t Get(TermId term_id) const {
+        const size_t chunk = term_id / CHUNK_SIZE;
+        return chunks_ && chunk < chunks_->size() ? (*(*chunks_)[chunk])[term_id % CHUNK_SIZE] : 0;
+    }
+
+    // Returns a copy with the (term id, delta) changes applied
+    DocumentFreqTable WithChanges(std::vector<std::pair<TermId, int64_t>> changes) const;
+
+private:
+    static constexpr size_t CHUNK_SIZE = 256;
+
+    using Chunk = std::array<uint32_t, CHUNK_SIZE>;
+
+    std::shared_ptr<const std::vector<std::shared_ptr<const Chunk>>> chunks_;
+};
+
+// Builds one segment from the live documents of adjacent parts, renumbered from first_ordinal
+// by status and then in part order. The result has no terms or documents if every document was removed, and
+// positions if all of the parts have them.
+std::shared_ptr<const IndexSegment> MergeSegments(ArrayView<IndexPart> parts, uint32_t first_ordinal);
\ No newline at end of file
@@ -0,0 +1,368 @@
+#include "index_snapshot.h"
+
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define INDEX_SNAPSHOT_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace snapshot {
+
+namespace {
+
+constexpr uint64_t SECTION_ALIGNMENT = 8;
+
+[[noreturn]] void ThrowCorrupted(const std::string& what) {
+    throw std::runtime_error("Invalid index snapshot: " + what);
+}
+
+// Flushes the file's data to the disk, so a rename never publishes a partly written file
+void SyncFile(const std::string& path) {
+#ifdef INDEX_SNAPSHOT_MMAP
+    const int descriptor = open(path.c_str(), O_RDONLY);
+    const bool is_synced = descriptor >= 0 && fsync(descriptor) == 0;
+    if (descriptor >= 0) {
+        close(descriptor);
+    }
+    if (!is_synced) {
+        throw std::runtime_error("Cannot sync " + path);
+    }
+#else
+    (void)path;
+#endif
+}
+
+}
+
+void Checksum::Update(const void* data, size_t size) {
+    const auto* bytes = static_cast<const uint8_t*>(data);
+    length_ += size;
+    while (size > 0 && pending_size_ != 0) {
+        pending_ |= static_cast<uint64_t>(*bytes++) << (8 * pending_size_++);
+        --size;
+        if (pending_size_ == sizeof(uint64_t)) {
+            Mix(pending_);
+            pending_ = 0;
+            pending_size_ = 0;
+        }
+    }
+    for (; size >= sizeof(uint64_t); size -= sizeof(uint64_t), bytes += sizeof(uint64_t)) {
+        uint64_t word;
+        std::memcpy(&word, bytes, sizeof(word));
+        Mix(word);
+    }
+    for (; size > 0; --size) {
+        pending_ |= static_cast<uint64_t>(*bytes++) << (8 * pending_size_++);
+    }
+}
+
+uint64_t Checksum::Finish() const {
+    Checksum result = *this;
+    result.Mix(result.pending_ ^ (static_cast<uint64_t>(result.pending_size_) << 56));
+    result.Mix(result.length_);
+    return result.state_;
+}
+
+void Checksum::Mix(uint64_t word) {
+    state_ = (state_ ^ word) * 0xFF51AFD7ED558CCDull;
+    state_ ^= state_ >> 32;
+}
+
+Writer::Writer(const std::string& path)
+    : path_(path)
+    , temp_path_(path + ".tmp")
+    , output_(temp_path_, std::ios::binary | std::ios::trunc)
+{
+    if (!output_) {
+        throw std::runtime_error("Cannot open " + temp_path_ + " for writing");
+    }
+    const Header placeholder{};
+    output_.write(reinterpret_cast<const char*>(&placeholder), sizeof(placeholder));
+    offset_ = sizeof(placeholder);
+}
+
+void Writer::Write(const void* data, size_t size) {
+    output_.write(static_cast<const char*>(data), size);
+    checksum_.Update(data, size);
+    offset_ += size;
+}
+
+uint64_t Writer::Align() {
+    static constexpr char PADDING[SECTION_ALIGNMENT] = {};
+    Write(PADDING, (SECTION_ALIGNMENT - offset_ % SECTION_ALIGNMENT) % SECTION_ALIGNMENT);
+    return offset_;
+}
+
+void Writer::Finish(Header header) {
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.format_version = FORMAT_VERSION;
+    header.byte_order_mark = BYTE_ORDER_MARK;
+    header.file_size = offset_;
+    header.checksum = checksum_.Finish();
+    output_.seekp(0);
+    output_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    output_.close();
+    if (!output_) {
+        throw std::runtime_error("Cannot write index snapshot");
+    }
+    SyncFile(temp_path_);
+    std::filesystem::rename(temp_path_, path_);
+    is_finished_ = true;
+}
+
+Writer::~Writer() {
+    if (!is_finished_) {
+        output_.close();
+        std::error_code error;
+        std::filesystem::remove(temp_path_, error);
+    }
+}
+
+#ifdef INDEX_SNAPSHOT_MMAP
+
+MappedFile::MappedFile(const std::string& path) {
+    const int descriptor = open(path.c_str(), O_RDONLY);
+    if (descriptor < 0) {
+        throw std::runtime_error("Cannot open " + path);
+    }
+    struct stat status;
+    if (fstat(descriptor, &status) != 0) {
+        close(descriptor);
+        throw std::runtime_error("Cannot read " + path);
+    }
+    size_ = static_cast<size_t>(status.st_size);
+    if (size_ > 0) {
+        void* mapping = mmap(nullptr, size_, PROT_READ, MAP_SHARED, descriptor, 0);
+        if (mapping == MAP_FAILED) {
+            close(descriptor);
+            throw std::runtime_error("Cannot map " + path);
+        }
+        data_ = static_cast<const char*>(mapping);
+    }
+    close(descriptor);
+}
+
+MappedFile::~MappedFile() {
+    if (data_ != nullptr) {
+        munmap(const_cast<char*>(data_), size_);
+    }
+}
+
+#else
+
+// Without mmap the file is read into memory once
+MappedFile::MappedFile(const std::string& path) {
+    std::ifstream input(path, std::ios::binary | std::ios::ate);
+    if (!input) {
+        throw std::runtime_error("Cannot open " + path);
+    }
+    buffer_.resize(static_cast<size_t>(input.tellg()));
+    input.seekg(0);
+    if (!input.read(buffer_.data(), buffer_.size())) {
+        throw std::runtime_error("Cannot read " + path);
+    }
+    data_ = buffer_.data();
+    size_ = buffer_.size();
+}
+
+MappedFile::~MappedFile() = default;
+
+#endif
+
+const char* MappedFile::data() const {
+    return data_;
+}
+
+size_t MappedFile::size() const {
+    return size_;
+}
+
+Reader::Reader(const std::string& path)
+    : file_(std::make_shared<const MappedFile>(path))
+{
+    if (file_->size() < sizeof(Header)) {
+        ThrowCorrupted("file is too short");
+    }
+    std::memcpy(&header_, file_->data(), sizeof(Header));
+    if (std::memcmp(header_.magic, MAGIC, sizeof(MAGIC)) != 0) {
+        ThrowCorrupted("bad magic");
+    }
+    if (header_.format_version != FORMAT_VERSION) {
+        ThrowCorrupted("unsupported format version " + std::to_string(header_.format_version));
+    }
+    if (header_.byte_order_mark != BYTE_ORDER_MARK) {
+        ThrowCorrupted("written with a different byte order");
+    }
+    if (header_.file_size != file_->size()) {
+        ThrowCorrupted("file size mismatch");
+    }
+    Checksum checksum;
+    checksum.Update(file_->data() + sizeof(Header), file_->size() - sizeof(Header));
+    if (checksum.Finish() != header_.checksum) {
+        ThrowCorrupted("checksum mismatch");
+    }
+
+    CheckSection<uint64_t>(header_.stop_word_offsets);
+    CheckSection<char>(header_.stop_word_chars);
+    CheckSection<uint64_t>(header_.term_offsets);
+    CheckSection<char>(header_.term_chars);
+    CheckSection<TermPostings>(header_.term_postings);
+    CheckSection<uint8_t>(header_.posting_bytes);
+    CheckSection<PostingList::SkipEntry>(header_.posting_blocks);
+    CheckSection<int32_t>(header_.ordinal_document_ids);
+    CheckSection<DocumentRecord>(header_.documents);
+    CheckSection<WordFrequencyRecord>(header_.word_frequencies);
+    CheckSection<TermPositions>(header_.term_positions);
+    CheckSection<uint8_t>(header_.position_bytes);
+    CheckSection<uint32_t>(header_.position_blocks);
+    CheckOffsets(header_.stop_word_offsets, header_.stop_word_chars);
+    CheckOffsets(header_.term_offsets, header_.term_chars);
+    CheckPostings();
+    CheckPositions();
+    CheckDocuments();
+}
+
+const Header& Reader::GetHeader() const {
+    return header_;
+}
+
+std::vector<std::string_view> Reader::GetStopWords() const {
+    const auto offsets = GetArray<uint64_t>(header_.stop_word_offsets);
+    const auto chars = GetArray<char>(header_.stop_word_chars);
+    std::vector<std::string_view> words;
+    for (size_t i = 0; i + 1 < offsets.size(); ++i) {
+        words.emplace_back(chars.data() + offsets[i], offsets[i + 1] - offsets[i]);
+    }
+    return words;
+}
+
+std::string_view Reader::GetTerm(uint32_t term_id) const {
+    const auto offsets = GetArray<uint64_t>(header_.term_offsets);
+    const auto chars = GetArray<char>(header_.term_chars);
+    return { chars.data() + offsets[term_id], offsets[term_id + 1] - offsets[term_id] };
+}
+
+PostingList Reader::GetPostings(uint32_t term_id) const {
+    const TermPostings& postings = GetArray<TermPostings>(header_.term_postings)[term_id];
+    const auto bytes = GetArray<uint8_t>(header_.posting_bytes);
+    const auto blocks = GetArray<PostingList::SkipEntry>(header_.posting_blocks);
+    return PostingList::FromExternal({ bytes.data() + postings.first_byte, static_cast<size_t>(postings.byte_count) },
+        { blocks.data() + postings.first_block, postings.block_count }, postings.posting_count, postings.max_term_freq);
+}
+
+bool Reader::HasPositions() const {
+    return header_.term_positions.count > 0;
+}
+
+PositionList Reader::GetPositions(uint32_t term_id) const {
+    const TermPositions& positions = GetArray<TermPositions>(header_.term_positions)[term_id];
+    const auto bytes = GetArray<uint8_t>(header_.position_bytes);
+    const auto blocks = GetArray<uint32_t>(header_.position_blocks);
+    return PositionList::FromExternal({ bytes.data() + positions.first_byte, static_cast<size_t>(positions.byte_count) },
+        { blocks.data() + positions.first_block, static_cast<size_t>(positions.block_count) },
+        GetArray<TermPostings>(header_.term_postings)[term_id].posting_count);
+}
+
+std::shared_ptr<const MappedFile> Reader::GetFile() const {
+    return file_;
+}
+
+template <typename T>
+void Reader::CheckSection(const Section& section) const {
+    const uint64_t size = file_->size();
+    if (section.offset % SECTION_ALIGNMENT != 0 || section.offset < sizeof(Header) || section.offset > size
+        || section.count > (size - section.offset) / sizeof(T)) {
+        ThrowCorrupted("section out of range");
+    }
+}
+
+void Reader::CheckOffsets(const Section& offsets, const Section& chars) const {
+    const auto values = GetArray<uint64_t>(offsets);
+    if (values.empty() || values[0] != 0 || values.back() != chars.count) {
+        ThrowCorrupted("bad string table");
+    }
+    for (size_t i = 1; i < values.size(); ++i) {
+        if (values[i] < values[i - 1]) {
+            ThrowCorrupted("bad string table");
+        }
+    }
+}
+
+void Reader::CheckPostings() const {
+    const auto term_postings = GetArray<TermPostings>(header_.term_postings);
+    const auto blocks = GetArray<PostingList::SkipEntry>(header_.posting_blocks);
+    const uint64_t byte_count = header_.posting_bytes.count;
+    const uint64_t ordinal_count = header_.ordinal_document_ids.count;
+    if (term_postings.size() + 1 != header_.term_offsets.count) {
+        ThrowCorrupted("term count mismatch");
+    }
+    // The encoded postings themselves are trusted once the checksum matches
+    for (const TermPostings& postings : term_postings) {
+        if (postings.byte_count > byte_count || postings.first_byte > byte_count - postings.byte_count
+            || postings.block_count > blocks.size() || postings.first_block > blocks.size() - postings.block_count
+            || postings.block_count != (postings.posting_count + PostingList::BLOCK_SIZE - 1) / PostingList::BLOCK_SIZE) {
+            ThrowCorrupted("posting list out of range");
+        }
+        for (uint32_t i = 0; i < postings.block_count; ++i) {
+            const auto& block = blocks[postings.first_block + i];
+            if (block.offset >= postings.byte_count || block.last_ordinal >= ordinal_count
+                || (i > 0 && block.last_ordinal <= blocks[postings.first_block + i - 1].last_ordinal)) {
+                ThrowCorrupted("bad posting block");
+            }
+        }
+    }
+}
+
+void Reader::CheckPositions() const {
+    const auto term_positions = GetArray<TermPositions>(header_.term_positions);
+    if (term_positions.empty()) {
+        return;
+    }
+    const auto term_postings = GetArray<TermPostings>(header_.term_postings);
+    const auto blocks = GetArray<uint32_t>(header_.position_blocks);
+    const uint64_t byte_count = header_.position_bytes.count;
+    if (term_positions.size() != term_postings.size()) {
+        ThrowCorrupted("term count mismatch");
+    }
+    // Like postings, the encoded positions are trusted once the checksum matches
+    for (size_t term_id = 0; term_id < term_positions.size(); ++term_id) {
+        const TermPositions& positions = term_positions[term_id];
+        if (positions.byte_count > byte_count || positions.first_byte > byte_count - positions.byte_count
+            || positions.block_count > blocks.size() || positions.first_block > blocks.size() - positions.block_count
+            || positions.block_count != term_postings[term_id].block_count) {
+            ThrowCorrupted("position list out of range");
+        }
+        for (uint64_t i = 0; i < positions.block_count; ++i) {
+            if (blocks[positions.first_block + i] >= positions.byte_count) {
+                ThrowCorrupted("bad position block");
+            }
+        }
+    }
+}
+
+void Reader::CheckDocuments() const {
+    const auto document_ids = GetArray<int32_t>(header_.ordinal_document_ids);
+    const uint64_t frequency_count = header_.word_frequencies.count;
+    const uint64_t term_count = header_.term_postings.count;
+    for (const DocumentRecord& document : GetArray<DocumentRecord>(header_.documents)) {
+        if (document.status < 0 || document.status > static_cast<int32_t>(DocumentStatus::REMOVED) || document.ordinal >= document_ids.size()
+            || document_ids[document.ordinal] != document.id
+            || document.word_frequency_count > frequency_count
+            || document.first_word_frequency > frequency_count - document.word_frequency_count) {
+            ThrowCorrupted("bad document record");
+        }
+    }
+    for (const WordFrequencyRecord& frequency : GetArray<WordFrequencyRecord>(header_.word_frequencies)) {
+        if (frequency.term_id >= term_count) {
+            ThrowCorrupted("bad word frequency record");
+        }
+    }
+}
+
+}
\ No newline at end of file
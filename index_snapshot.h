@@ -0,0 +1,198 @@
+#pragma once
+
+#include "array_view.h"
+#include "document.h"
+#include "position_list.h"
+#include "posting_list.h"
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Binary index snapshot. The file is a Header followed by 8-byte aligned sections of
+// plain fixed-size records in the writer's byte order, so a reader can use them in place
+// after mapping the file. The checksum covers everything after the header and guards
+// against truncated or corrupted files.
+namespace snapshot {
+
+inline constexpr char MAGIC[8] = { 'S', 'R', 'C', 'H', 'I', 'D', 'X', '\0' };
+inline constexpr uint32_t FORMAT_VERSION = 3;
+inline constexpr uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+struct Section {
+    uint64_t offset;
+    uint64_t count;
+};
+
+struct Header {
+    char magic[8];
+    uint32_t format_version;
+    uint32_t byte_order_mark;
+    uint64_t file_size;
+    uint64_t checksum;
+    Section stop_word_offsets;      // uint64_t, one per stop word plus the end
+    Section stop_word_chars;        // char
+    Section term_offsets;           // uint64_t, one per term plus the end
+    Section term_chars;             // char
+    Section term_postings;          // TermPostings, indexed by term id
+    Section posting_bytes;          // uint8_t
+    Section posting_blocks;         // PostingList::SkipEntry
+    Section ordinal_document_ids;   // int32_t, indexed by ordinal
+    Section documents;              // DocumentRecord
+    Section word_frequencies;       // WordFrequencyRecord
+    Section term_positions;         // TermPositions, indexed by term id; empty without the positional index
+    Section position_bytes;         // uint8_t
+    Section position_blocks;        // uint32_t, offsets into a term's position bytes
+};
+
+struct TermPostings {
+    uint64_t first_byte;
+    uint64_t byte_count;
+    uint64_t first_block;
+    uint32_t block_count;
+    uint32_t posting_count;
+    double max_term_freq;
+};
+
+struct TermPositions {
+    uint64_t first_byte;
+    uint64_t byte_count;
+    uint64_t first_block;
+    uint64_t block_count;
+};
+
+struct DocumentRecord {
+    int32_t id;
+    int32_t rating;
+    int32_t status;
+    uint32_t ordinal;
+    double inv_word_count;
+    uint64_t first_word_frequency;
+    uint64_t word_frequency_count;
+};
+
+struct WordFrequencyRecord {
+    uint32_t term_id;
+    uint32_t reserved;
+    double term_freq;
+};
+
+class Checksum {
+public:
+    void Update(const void* data, size_t size);
+
+    uint64_t Finish() const;
+
+private:
+    uint64_t state_ = 0x9E3779B97F4A7C15ull;
+    uint64_t pending_ = 0;
+    size_t pending_size_ = 0;
+    uint64_t length_ = 0;
+
+    void Mix(uint64_t word);
+};
+
+// Writes the snapshot to path + ".tmp" and renames it over path once it is complete and
+// synced, so a failed save leaves the old file intact and servers that have it mapped keep
+// reading the old contents.
+class Writer {
+public:
+    explicit Writer(const std::string& path);
+
+    Writer(const Writer&) = delete;
+    Writer& operator=(const Writer&) = delete;
+
+    // Removes the temporary file unless Finish succeeded
+    ~Writer();
+
+    void Write(const void* data, size_t size);
+
+    // Pads the file to the next section boundary and returns the offset there
+    uint64_t Align();
+
+    template <typename T>
+    Section WriteArray(const std::vector<T>& values) {
+        const uint64_t offset = Align();
+        Write(values.data(), values.size() * sizeof(T));
+        return { offset, values.size() };
+    }
+
+    // Completes the header with the file size and checksum, writes it at the start and
+    // replaces the file at path
+    void Finish(Header header);
+
+private:
+    std::string path_;
+    std::string temp_path_;
+    std::ofstream output_;
+    bool is_finished_ = false;
+    Checksum checksum_;
+    uint64_t offset_ = 0;
+};
+
+// Read-only mapping of a whole file
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path);
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile();
+
+    const char* data() const;
+
+    size_t size() const;
+
+private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+    std::vector<char> buffer_;
+};
+
+// Maps a snapshot and checks its header, checksum and the ranges of every section and
+// cross-reference, so that users of the sections need no further bounds checks.
+// Throws std::runtime_error if the file is not a valid snapshot.
+class Reader {
+public:
+    explicit Reader(const std::string& path);
+
+    const Header& GetHeader() const;
+
+    template <typename T>
+    ArrayView<T> GetArray(const Section& section) const {
+        return { reinterpret_cast<const T*>(file_->data() + section.offset), static_cast<size_t>(section.count) };
+    }
+
+    std::vector<std::string_view> GetStopWords() const;
+
+    std::string_view GetTerm(uint32_t term_id) const;
+
+    PostingList GetPostings(uint32_t term_id) const;
+
+    bool HasPositions() const;
+
+    PositionList GetPositions(uint32_t term_id) const;
+
+    std::shared_ptr<const MappedFile> GetFile() const;
+
+private:
+    std::shared_ptr<const MappedFile> file_;
+    Header header_;
+
+    template <typename T>
+    void CheckSection(const Section& section) const;
+
+    void CheckOffsets(const Section& offsets, const Section& chars) const;
+
+    void CheckPostings() const;
+
+    void CheckPositions() const;
+
+    void CheckDocuments() const;
+};
+
+}
\ No newline at end of file
@@ -1,5 +1,6 @@
 #include "process_queries.h"
 #include "search_server.h"
+#include "test_search_server.h"
 
 #include "log_duration.h"
 
@@ -7,6 +8,7 @@
 #include <iostream>
 #include <random>
 #include <string>
+#include <tuple>
 #include <vector>
 
 using namespace std;
@@ -54,9 +56,43 @@ vector<string> GenerateQueries(mt19937& generator, const vector<string>& diction
     return queries;
 }
 
+// Draws words with probability inversely proportional to their position in the dictionary,
+// so that a few words are common and most are rare, as in natural text
+vector<string> GenerateZipfQueries(mt19937& generator, const vector<string>& dictionary, int query_count, int max_word_count) {
+    vector<double> weights;
+    weights.reserve(dictionary.size());
+    for (size_t i = 0; i < dictionary.size(); ++i) {
+        weights.push_back(1.0 / (i + 1));
+    }
+    discrete_distribution<size_t> word_index(weights.begin(), weights.end());
+    vector<string> queries;
+    queries.reserve(query_count);
+    for (int i = 0; i < query_count; ++i) {
+        string query;
+        const int word_count = uniform_int_distribution(1, max_word_count)(generator);
+        for (int j = 0; j < word_count; ++j) {
+            if (!query.empty()) {
+                query.push_back(' ');
+            }
+            query += dictionary[word_index(generator)];
+        }
+        queries.push_back(move(query));
+    }
+    return queries;
+}
+
+void AddDocuments(SearchServer& search_server, const vector<string>& documents) {
+    vector<tuple<int, string_view, DocumentStatus, vector<int>>> new_documents;
+    new_documents.reserve(documents.size());
+    for (size_t i = 0; i < documents.size(); ++i) {
+        new_documents.emplace_back(i, documents[i], DocumentStatus::ACTUAL, vector<int>{ 1, 2, 3 });
+    }
+    search_server.AddDocuments(new_documents);
+}
+
 template <typename ExecutionPolicy>
 void Test(string_view mark, const SearchServer& search_server, const vector<string>& queries, ExecutionPolicy&& policy) {
-    LOG_DURATION(mark);
+    LOG_DURATION(string{ mark });
     double total_relevance = 0;
     for (const string_view query : queries) {
         for (const auto& document : search_server.FindTopDocuments(policy, query)) {
@@ -69,18 +105,34 @@ void Test(string_view mark, const SearchServer& search_server, const vector<stri
 #define TEST(policy) Test(#policy, search_server, queries, execution::policy)
 
 int main() {
+    TestSearchServer();
+
     mt19937 generator;
 
-    const auto dictionary = GenerateDictionary(generator, 1000, 10);
-    const auto documents = GenerateQueries(generator, dictionary, 10'000, 70);
+    {
+        const auto dictionary = GenerateDictionary(generator, 1000, 10);
+        const auto documents = GenerateQueries(generator, dictionary, 10'000, 70);
+        SearchServer search_server(dictionary[0]);
+        AddDocuments(search_server, documents);
 
-    SearchServer search_server(dictionary[0]);
-    for (size_t i = 0; i < documents.size(); ++i) {
-        search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, { 1, 2, 3 });
+        const auto queries = GenerateQueries(generator, dictionary, 100, 70);
+
+        TEST(seq);
+        TEST(par);
+        Test("wand"sv, search_server, queries, search_policy::wand);
     }
 
-    const auto queries = GenerateQueries(generator, dictionary, 100, 70);
+    // Short queries over skewed word frequencies: once the top results contain a query's
+    // rare words, WAND skips most postings of its common words
+    {
+        const auto dictionary = GenerateDictionary(generator, 20'000, 10);
+        const auto documents = GenerateZipfQueries(generator, dictionary, 100'000, 70);
+        SearchServer search_server(dictionary[0]);
+        AddDocuments(search_server, documents);
 
-    TEST(seq);
-    TEST(par);
+        const auto queries = GenerateZipfQueries(generator, dictionary, 1'000, 4);
+
+        TEST(seq);
+        Test("wand"sv, search_server, queries, search_policy::wand);
+    }
 }
\ No newline at end of file
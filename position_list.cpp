@@ -0,0 +1,109 @@
+#include "position_list.h"
+
+#include "posting_list.h"
+
+namespace {
+
+void WriteVarint(std::vector<uint8_t>& bytes, uint32_t value) {
+    while (value >= 0x80) {
+        bytes.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    bytes.push_back(static_cast<uint8_t>(value));
+}
+
+uint32_t ReadVarint(const uint8_t*& position) {
+    uint32_t value = *position & 0x7F;
+    for (int shift = 7; *position++ & 0x80; shift += 7) {
+        value |= static_cast<uint32_t>(*position & 0x7F) << shift;
+    }
+    return value;
+}
+
+void SkipVarint(const uint8_t*& position) {
+    while (*position++ & 0x80) {
+    }
+}
+
+}
+
+PositionList::Cursor::Cursor(const PositionList& list, size_t posting_index)
+    : position_(list.GetBytes().data())
+{
+    if (posting_index == 0) {
+        return;
+    }
+    position_ += list.GetBlockOffsets()[posting_index / PostingList::BLOCK_SIZE];
+    for (size_t i = posting_index % PostingList::BLOCK_SIZE; i > 0; --i) {
+        for (uint32_t count = ReadVarint(position_); count > 0; --count) {
+            SkipVarint(position_);
+        }
+    }
+}
+
+void PositionList::Cursor::Read(std::pmr::vector<uint32_t>& positions) {
+    positions.resize(ReadVarint(position_));
+    uint32_t previous = 0;
+    for (uint32_t& value : positions) {
+        previous += ReadVarint(position_);
+        value = previous;
+    }
+}
+
+PositionList PositionList::FromExternal(ArrayView<uint8_t> bytes, ArrayView<uint32_t> block_offsets, size_t size) {
+    PositionList list;
+    list.external_bytes_ = bytes;
+    list.external_block_offsets_ = block_offsets;
+    list.is_external_ = true;
+    list.size_ = size;
+    return list;
+}
+
+void PositionList::Append(const uint32_t* positions, size_t count) {
+    if (is_external_) {
+        MakeOwned();
+    }
+    if (size_ % PostingList::BLOCK_SIZE == 0) {
+        block_offsets_.push_back(static_cast<uint32_t>(bytes_.size()));
+    }
+    WriteVarint(bytes_, static_cast<uint32_t>(count));
+    uint32_t previous = 0;
+    for (size_t i = 0; i < count; ++i) {
+        WriteVarint(bytes_, positions[i] - previous);
+        previous = positions[i];
+    }
+    ++size_;
+}
+
+void PositionList::Get(size_t posting_index, std::pmr::vector<uint32_t>& positions) const {
+    Cursor(*this, posting_index).Read(positions);
+}
+
+PositionList::Cursor PositionList::GetCursor() const {
+    return Cursor(*this);
+}
+
+size_t PositionList::size() const {
+    return size_;
+}
+
+ArrayView<uint8_t> PositionList::GetBytes() const {
+    return is_external_ ? external_bytes_ : ArrayView<uint8_t>(bytes_.data(), bytes_.size());
+}
+
+ArrayView<uint32_t> PositionList::GetBlockOffsets() const {
+    return is_external_ ? external_block_offsets_ : ArrayView<uint32_t>(block_offsets_.data(), block_offsets_.size());
+}
+
+void PositionList::ShrinkToFit() {
+    bytes_.shrink_to_fit();
+    block_offsets_.shrink_to_fit();
+}
+
+void PositionList::MakeOwned() {
+    bytes_.assign(external_bytes_.begin(), external_bytes_.end());
+    block_offsets_.assign(external_block_offsets_.begin(), external_block_offsets_.end());
+    external_bytes_ = {};
+    external_block_offsets_ = {};
+    is_external_ = false;
+}
\ No newline at end of file
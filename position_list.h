@@ -0,0 +1,62 @@
+#pragma once
+
+#include "array_view.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <vector>
+
+// Word positions of the postings of one term, kept in posting order next to the term's
+// PostingList. A posting's entry is the varint number of positions followed by varint
+// deltas of the ascending positions. The entry of every PostingList::BLOCK_SIZE-th posting
+// has its offset recorded, so finding a posting's positions skips at most one block.
+class PositionList {
+public:
+    // Reads the entries one posting after another
+    class Cursor {
+    public:
+        // Starts at posting number posting_index, which has to exist unless it is 0
+        explicit Cursor(const PositionList& list, size_t posting_index = 0);
+
+        // Replaces positions with those of the next posting
+        void Read(std::pmr::vector<uint32_t>& positions);
+
+    private:
+        const uint8_t* position_;
+    };
+
+    PositionList() = default;
+
+    // Makes a list that reads its entries from memory it does not own, such as a mapped
+    // snapshot. The memory has to outlive the list; Append copies the entries first.
+    static PositionList FromExternal(ArrayView<uint8_t> bytes, ArrayView<uint32_t> block_offsets, size_t size);
+
+    // Adds the positions of the next posting; they have to be ascending
+    void Append(const uint32_t* positions, size_t count);
+
+    // Replaces positions with those of posting number posting_index
+    void Get(size_t posting_index, std::pmr::vector<uint32_t>& positions) const;
+
+    Cursor GetCursor() const;
+
+    size_t size() const;
+
+    // Entries, see the class comment
+    ArrayView<uint8_t> GetBytes() const;
+
+    ArrayView<uint32_t> GetBlockOffsets() const;
+
+    void ShrinkToFit();
+
+private:
+    std::vector<uint8_t> bytes_;
+    std::vector<uint32_t> block_offsets_;
+    ArrayView<uint8_t> external_bytes_;
+    ArrayView<uint32_t> external_block_offsets_;
+    bool is_external_ = false;
+    size_t size_ = 0;
+
+    // Moves external entries into bytes_ and block_offsets_ so that they can be extended
+    void MakeOwned();
+};
\ No newline at end of file
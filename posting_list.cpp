@@ -0,0 +1,161 @@
+#include "posting_list.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+PostingList::Cursor::Cursor(const PostingList& list)
+    : list_(&list)
+    , position_(list.GetBytes().data())
+    , remaining_(list.size_)
+{
+    if (remaining_ > 0) {
+        DecodeNext();
+    }
+}
+
+void PostingList::Cursor::SkipTo(uint32_t ordinal) {
+    if (IsEnd() || ordinal_ >= ordinal) {
+        return;
+    }
+    const SkipEntry* block = PeekBlock(ordinal);
+    if (block == nullptr) {
+        remaining_ = 0;
+        return;
+    }
+    const size_t block_index = block - list_->GetBlocks().data();
+    if (block_index != GetCurrentBlock()) {
+        EnterBlock(block_index);
+    }
+    while (ordinal_ < ordinal) {
+        Next();
+        if (IsEnd()) {
+            return;
+        }
+    }
+}
+
+void PostingList::Cursor::ReadBlock(uint32_t end_ordinal, DecodedBlock& block) {
+    const size_t block_remaining = std::min(remaining_, BLOCK_SIZE - (list_->size_ - remaining_) % BLOCK_SIZE);
+    block.size = 0;
+    while (block.size < block_remaining && ordinal_ < end_ordinal) {
+        block.ordinals[block.size] = ordinal_;
+        block.counts[block.size] = count_;
+        ++block.size;
+        Next();
+    }
+}
+
+const PostingList::SkipEntry* PostingList::Cursor::PeekBlock(uint32_t ordinal) const {
+    if (IsEnd()) {
+        return nullptr;
+    }
+    const auto skips = list_->GetBlocks();
+    const size_t current_block = GetCurrentBlock();
+    if (skips[current_block].last_ordinal >= ordinal) {
+        return &skips[current_block];
+    }
+    // Gallop over the skip entries first: intersections mostly skip to nearby blocks
+    size_t low = current_block + 1;
+    size_t step = 1;
+    while (low + step < skips.size() && skips[low + step - 1].last_ordinal < ordinal) {
+        low += step;
+        step *= 2;
+    }
+    const auto high = skips.begin() + std::min(low + step, skips.size());
+    const auto it = std::lower_bound(skips.begin() + low, high, ordinal,
+        [](const SkipEntry& entry, uint32_t value) { return entry.last_ordinal < value; });
+    return it == skips.end() ? nullptr : &*it;
+}
+
+size_t PostingList::Cursor::GetCurrentBlock() const {
+    return (list_->size_ - remaining_) / BLOCK_SIZE;
+}
+
+void PostingList::Cursor::EnterBlock(size_t block) {
+    const auto skips = list_->GetBlocks();
+    position_ = list_->GetBytes().data() + skips[block].offset;
+    remaining_ = list_->size_ - block * BLOCK_SIZE;
+    ordinal_ = block == 0 ? 0 : skips[block - 1].last_ordinal;
+    DecodeNext();
+}
+
+PostingList PostingList::FromExternal(ArrayView<uint8_t> bytes, ArrayView<SkipEntry> skips, size_t size, double max_term_freq) {
+    PostingList list;
+    list.external_bytes_ = bytes;
+    list.external_skips_ = skips;
+    list.is_external_ = true;
+    list.size_ = size;
+    list.max_term_freq_ = max_term_freq;
+    return list;
+}
+
+void PostingList::Append(uint32_t ordinal, uint32_t count, double term_freq) {
+    if (is_external_) {
+        MakeOwned();
+    }
+    const uint32_t previous_ordinal = skips_.empty() ? 0 : skips_.back().last_ordinal;
+    if (!skips_.empty() && ordinal <= previous_ordinal) {
+        throw std::invalid_argument("Postings must be appended in increasing ordinal order");
+    }
+    if (size_ % BLOCK_SIZE == 0) {
+        skips_.push_back({ ordinal, static_cast<uint32_t>(bytes_.size()), 0.0 });
+    }
+    WriteVarint(bytes_, ordinal - previous_ordinal);
+    WriteVarint(bytes_, count);
+    SkipEntry& block = skips_.back();
+    block.last_ordinal = ordinal;
+    block.max_term_freq = std::max(block.max_term_freq, term_freq);
+    max_term_freq_ = std::max(max_term_freq_, term_freq);
+    ++size_;
+}
+
+bool PostingList::Contains(uint32_t ordinal) const {
+    Cursor cursor = GetCursor();
+    cursor.SkipTo(ordinal);
+    return !cursor.IsEnd() && cursor.GetOrdinal() == ordinal;
+}
+
+PostingList::Cursor PostingList::GetCursor() const {
+    return Cursor(*this);
+}
+
+size_t PostingList::size() const {
+    return size_;
+}
+
+bool PostingList::empty() const {
+    return size_ == 0;
+}
+
+double PostingList::GetMaxTermFreq() const {
+    return max_term_freq_;
+}
+
+ArrayView<PostingList::SkipEntry> PostingList::GetBlocks() const {
+    return is_external_ ? external_skips_ : ArrayView<SkipEntry>(skips_.data(), skips_.size());
+}
+
+ArrayView<uint8_t> PostingList::GetBytes() const {
+    return is_external_ ? external_bytes_ : ArrayView<uint8_t>(bytes_.data(), bytes_.size());
+}
+
+void PostingList::ShrinkToFit() {
+    bytes_.shrink_to_fit();
+    skips_.shrink_to_fit();
+}
+
+void PostingList::MakeOwned() {
+    bytes_.assign(external_bytes_.begin(), external_bytes_.end());
+    skips_.assign(external_skips_.begin(), external_skips_.end());
+    external_bytes_ = {};
+    external_skips_ = {};
+    is_external_ = false;
+}
+
+void PostingList::WriteVarint(std::vector<uint8_t>& bytes, uint32_t value) {
+    while (value >= 0x80) {
+        bytes.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    bytes.push_back(static_cast<uint8_t>(value));
+}
\ No newline at end of file
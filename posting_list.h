@@ -0,0 +1,132 @@
+#pragma once
+
+#include "array_view.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Append-only compressed posting list. Postings must be appended in strictly increasing
+// ordinal order and are stored in blocks of BLOCK_SIZE entries: each entry is a varint
+// ordinal delta followed by the varint number of occurrences of the term in the document.
+// Every block has a skip entry with the block's last ordinal and an upper bound of its term
+// frequencies, so cursors can jump over blocks and bound their scores without decoding them.
+class PostingList {
+public:
+    static constexpr size_t BLOCK_SIZE = 128;
+
+    struct SkipEntry {
+        uint32_t last_ordinal;
+        uint32_t offset;
+        double max_term_freq;
+    };
+
+    // Postings decoded from one block, for scoring them in a batch
+    struct DecodedBlock {
+        uint32_t ordinals[BLOCK_SIZE];
+        uint32_t counts[BLOCK_SIZE];
+        size_t size = 0;
+    };
+
+    class Cursor {
+    public:
+        explicit Cursor(const PostingList& list);
+
+        bool IsEnd() const {
+            return remaining_ == 0;
+        }
+
+        uint32_t GetOrdinal() const {
+            return ordinal_;
+        }
+
+        uint32_t GetCount() const {
+            return count_;
+        }
+
+        // Number of postings before the current one
+        size_t GetIndex() const {
+            return list_->size_ - remaining_;
+        }
+
+        void Next() {
+            if (--remaining_ > 0) {
+                DecodeNext();
+            }
+        }
+
+        // Moves to the first posting with ordinal not less than the given one
+        void SkipTo(uint32_t ordinal);
+
+        // Decodes the postings from the current one to the end of its block, stopping at the
+        // first ordinal not less than end_ordinal, and moves past them
+        void ReadBlock(uint32_t end_ordinal, DecodedBlock& block);
+
+        // Returns the skip entry of the block SkipTo(ordinal) would stop in, or nullptr
+        // if there is no such posting. The cursor itself does not move.
+        const SkipEntry* PeekBlock(uint32_t ordinal) const;
+
+    private:
+        const PostingList* list_;
+        const uint8_t* position_;
+        size_t remaining_;
+        uint32_t ordinal_ = 0;
+        uint32_t count_ = 0;
+
+        void DecodeNext() {
+            ordinal_ += ReadVarint(position_);
+            count_ = ReadVarint(position_);
+        }
+
+        size_t GetCurrentBlock() const;
+
+        void EnterBlock(size_t block);
+    };
+
+    PostingList() = default;
+
+    // Makes a list that reads its postings from memory it does not own, such as a mapped
+    // snapshot. The memory has to outlive the list; Append copies the postings first.
+    static PostingList FromExternal(ArrayView<uint8_t> bytes, ArrayView<SkipEntry> skips, size_t size, double max_term_freq);
+
+    void Append(uint32_t ordinal, uint32_t count, double term_freq);
+
+    bool Contains(uint32_t ordinal) const;
+
+    Cursor GetCursor() const;
+
+    size_t size() const;
+
+    bool empty() const;
+
+    double GetMaxTermFreq() const;
+
+    ArrayView<SkipEntry> GetBlocks() const;
+
+    // Encoded postings, see the class comment
+    ArrayView<uint8_t> GetBytes() const;
+
+    void ShrinkToFit();
+
+private:
+    std::vector<uint8_t> bytes_;
+    std::vector<SkipEntry> skips_;
+    ArrayView<uint8_t> external_bytes_;
+    ArrayView<SkipEntry> external_skips_;
+    bool is_external_ = false;
+    size_t size_ = 0;
+    double max_term_freq_ = 0.0;
+
+    // Moves external postings into bytes_ and skips_ so that they can be extended
+    void MakeOwned();
+
+    static void WriteVarint(std::vector<uint8_t>& bytes, uint32_t value);
+
+    static uint32_t ReadVarint(const uint8_t*& position) {
+        uint32_t value = *position & 0x7F;
+        for (int shift = 7; *position++ & 0x80; shift += 7) {
+            value |= static_cast<uint32_t>(*position & 0x7F) << shift;
+        }
+        return value;
+    }
+};
\ No newline at end of file
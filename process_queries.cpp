@@ -1,28 +1,151 @@
 #include "process_queries.h"
 
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+
 std::vector<std::vector<Document>> ProcessQueries(
 	const SearchServer& search_server,
 	const std::vector<std::string>& queries) {
 	std::vector<std::vector<Document>> result(queries.size());
-	transform(
-		std::execution::par,
-		queries.begin(),
-		queries.end(),
-		result.begin(),
-		[&search_server](const std::string& query) { return search_server.FindTopDocuments(query); }
-	);
+	// One query per index: workers claim queries one at a time, so a few expensive
+	// queries cannot hold back a whole chunk of cheap ones
+	search_server.GetThreadPool().ParallelFor(queries.size(), [&](size_t i) {
+		result[i] = search_server.FindTopDocuments(queries[i]);
+	});
 	return result;
 }
 
+std::vector<std::vector<Document>> ProcessQueriesBatched(
+	const SearchServer& search_server,
+	const std::vector<std::string>& queries) {
+	return search_server.FindTopDocumentsBatch(queries);
+}
+
 std::vector<Document> ProcessQueriesJoined(
 	const SearchServer& search_server,
 	const std::vector<std::string>& queries) {
 	std::vector<Document> result;
 	result.reserve(queries.size());
-	for (const auto& vec : ProcessQueries(search_server, queries)) {
-		for (const auto& document : vec) {
-			result.push_back(std::move(document));
+	ProcessQueriesJoined(search_server, queries, [&result](const Document& document) {
+		result.push_back(document);
+	});
+	return result;
+}
+
+namespace {
+
+struct JoinedQueriesState {
+	explicit JoinedQueriesState(size_t window)
+		: results(window)
+		, errors(window)
+		, is_ready(window, false)
+	{
+
+	}
+
+	std::mutex mutex;
+	std::condition_variable result_ready;
+	std::vector<std::vector<Document>> results;
+	std::vector<std::exception_ptr> errors;
+	std::vector<bool> is_ready;
+	size_t next_query = 0;
+	size_t query_limit = 0;
+	size_t running_count = 0;
+};
+
+// Evaluates the next unclaimed query below the limit; returns false if there is none
+bool RunNextQuery(JoinedQueriesState& state, const SearchServer& search_server, const std::vector<std::string>& queries) {
+	size_t query_index;
+	{
+		std::lock_guard guard(state.mutex);
+		if (state.next_query >= state.query_limit) {
+			return false;
 		}
+		query_index = state.next_query++;
+		++state.running_count;
+	}
+
+	std::vector<Document> documents;
+	std::exception_ptr error;
+	try {
+		documents = search_server.FindTopDocuments(queries[query_index]);
+	}
+	catch (...) {
+		error = std::current_exception();
+	}
+
+	{
+		std::lock_guard guard(state.mutex);
+		const size_t slot = query_index % state.results.size();
+		state.results[slot] = std::move(documents);
+		state.errors[slot] = error;
+		state.is_ready[slot] = true;
+		--state.running_count;
+	}
+	state.result_ready.notify_all();
+	return true;
+}
+
+}
+
+void ProcessQueriesJoined(
+	const SearchServer& search_server,
+	const std::vector<std::string>& queries,
+	const std::function<void(const Document&)>& sink) {
+	ThreadPool& thread_pool = search_server.GetThreadPool();
+	const size_t window = (thread_pool.GetWorkerCount() + 1) * 4;
+	const auto state = std::make_shared<JoinedQueriesState>(window);
+	state->query_limit = std::min(window, queries.size());
+
+	// Helpers may outlive this call, but once every query is claimed they touch nothing
+	// except the shared state
+	const auto helper = [state, &search_server, &queries] {
+		while (RunNextQuery(*state, search_server, queries)) {
+		}
+	};
+	for (size_t i = 0; i < std::min(state->query_limit, thread_pool.GetWorkerCount()); ++i) {
+		thread_pool.Submit(helper);
+	}
+
+	try {
+		for (size_t i = 0; i < queries.size(); ++i) {
+			const size_t slot = i % window;
+			std::unique_lock lock(state->mutex);
+			while (!state->is_ready[slot]) {
+				lock.unlock();
+				const bool has_run = RunNextQuery(*state, search_server, queries);
+				lock.lock();
+				if (!has_run) {
+					state->result_ready.wait(lock, [&] { return state->is_ready[slot]; });
+				}
+			}
+			const std::vector<Document> documents = std::move(state->results[slot]);
+			const std::exception_ptr error = state->errors[slot];
+			state->is_ready[slot] = false;
+			const bool has_more_queries = i + window < queries.size();
+			if (has_more_queries) {
+				state->query_limit = i + window + 1;
+			}
+			lock.unlock();
+
+			if (has_more_queries) {
+				thread_pool.Submit(helper);
+			}
+
+			if (error) {
+				std::rethrow_exception(error);
+			}
+			for (const Document& document : documents) {
+				sink(document);
+			}
+		}
+	}
+	catch (...) {
+		std::unique_lock lock(state->mutex);
+		state->query_limit = state->next_query;
+		state->result_ready.wait(lock, [&] { return state->running_count == 0; });
+		throw;
 	}
-	return result;
 }
\ No newline at end of file
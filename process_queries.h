@@ -1,9 +1,24 @@
 #include "search_server.h"
 
+#include <functional>
+
 std::vector<std::vector<Document>> ProcessQueries(
     const SearchServer& search_server,
     const std::vector<std::string>& queries);
 
+// Same results as ProcessQueries, but evaluates the whole batch in one pass over the
+// posting lists, which pays off when many queries share terms
+std::vector<std::vector<Document>> ProcessQueriesBatched(
+    const SearchServer& search_server,
+    const std::vector<std::string>& queries);
+
 std::vector<Document> ProcessQueriesJoined(
     const SearchServer& search_server,
-    const std::vector<std::string>& queries);
\ No newline at end of file
+    const std::vector<std::string>& queries);
+
+// Passes the results of all queries to sink in query order. Queries are evaluated ahead
+// on the server's thread pool, but only a bounded window of results is kept in memory.
+void ProcessQueriesJoined(
+    const SearchServer& search_server,
+    const std::vector<std::string>& queries,
+    const std::function<void(const Document&)>& sink);
\ No newline at end of file
@@ -0,0 +1,67 @@
+#include "query_arena.h"
+
+#include <algorithm>
+
+QueryArena::Scope::Scope()
+    : arena_(ForCurrentThread())
+{
+    ++arena_.scope_depth_;
+}
+
+QueryArena::Scope::~Scope() {
+    if (--arena_.scope_depth_ == 0) {
+        arena_.Reset();
+    }
+}
+
+QueryArena& QueryArena::ForCurrentThread() {
+    thread_local QueryArena arena;
+    return arena;
+}
+
+size_t QueryArena::GetCapacity() const {
+    size_t capacity = 0;
+    for (const Block& block : blocks_) {
+        capacity += block.size;
+    }
+    return capacity;
+}
+
+void QueryArena::Reset() {
+    // A query that outgrew the first block gets one block big enough for all of it next time.
+    // The block is capped, so one huge query or batch does not pin its peak on the thread.
+    const size_t capacity = GetCapacity();
+    const size_t kept_size = std::min(capacity, MAX_KEPT_SIZE);
+    if (blocks_.size() > 1 || kept_size < capacity) {
+        blocks_.clear();
+        blocks_.push_back({ std::make_unique<std::byte[]>(kept_size), kept_size });
+    }
+    current_block_ = 0;
+    current_block_used_ = 0;
+}
+
+void* QueryArena::do_allocate(size_t bytes, size_t alignment) {
+    while (current_block_ < blocks_.size()) {
+        Block& block = blocks_[current_block_];
+        void* pointer = block.data.get() + current_block_used_;
+        size_t space = block.size - current_block_used_;
+        if (std::align(alignment, bytes, pointer, space) != nullptr) {
+            current_block_used_ = block.size - space + bytes;
+            return pointer;
+        }
+        ++current_block_;
+        current_block_used_ = 0;
+    }
+    const size_t size = std::max({ MIN_BLOCK_SIZE, bytes + alignment, blocks_.empty() ? 0 : blocks_.back().size * 2 });
+    blocks_.push_back({ std::make_unique<std::byte[]>(size), size });
+    current_block_ = blocks_.size() - 1;
+    current_block_used_ = 0;
+    return do_allocate(bytes, alignment);
+}
+
+void QueryArena::do_deallocate(void*, size_t, size_t) {
+}
+
+bool QueryArena::do_is_equal(const std::pmr::memory_resource& other) const noexcept {
+    return this == &other;
+}
\ No newline at end of file
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <vector>
+
+// Per-thread monotonic memory for the scratch containers of a query. Deallocation is a
+// no-op; everything is released at once when the outermost Scope on the thread ends. The
+// arena keeps up to MAX_KEPT_SIZE between queries, so steady-state queries do not touch
+// the heap.
+class QueryArena : public std::pmr::memory_resource {
+public:
+    static constexpr size_t MAX_KEPT_SIZE = 4 * 1024 * 1024;
+
+    // Containers drawing from the arena have to be destroyed before the scope that was
+    // open when they allocated ends. Scopes may nest.
+    class Scope {
+    public:
+        Scope();
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+        ~Scope();
+
+    private:
+        QueryArena& arena_;
+    };
+
+    QueryArena() = default;
+
+    QueryArena(const QueryArena&) = delete;
+    QueryArena& operator=(const QueryArena&) = delete;
+
+    static QueryArena& ForCurrentThread();
+
+    // Total size of the blocks the arena holds
+    size_t GetCapacity() const;
+
+private:
+    static constexpr size_t MIN_BLOCK_SIZE = 64 * 1024;
+
+    struct Block {
+        std::unique_ptr<std::byte[]> data;
+        size_t size;
+    };
+
+    std::vector<Block> blocks_;
+    size_t current_block_ = 0;
+    size_t current_block_used_ = 0;
+    size_t scope_depth_ = 0;
+
+    void Reset();
+
+    void* do_allocate(size_t bytes, size_t alignment) override;
+
+    void do_deallocate(void* pointer, size_t bytes, size_t alignment) override;
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+};
\ No newline at end of file
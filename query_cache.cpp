@@ -0,0 +1,60 @@
+#include "query_cache.h"
+
+#include <functional>
+
+QueryCache::QueryCache(size_t capacity)
+    : shard_capacity_((capacity + SHARD_COUNT - 1) / SHARD_COUNT)
+{
+
+}
+
+std::optional<std::vector<Document>> QueryCache::Find(const std::string& key, uint64_t generation) {
+    Shard& shard = GetShard(key);
+    std::lock_guard guard(shard.mutex);
+    const auto it = shard.positions.find(key);
+    if (it == shard.positions.end()) {
+        ++misses_;
+        return std::nullopt;
+    }
+    if (it->second->generation != generation) {
+        shard.entries.erase(it->second);
+        shard.positions.erase(it);
+        ++misses_;
+        return std::nullopt;
+    }
+    shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+    ++hits_;
+    return it->second->documents;
+}
+
+void QueryCache::Insert(const std::string& key, uint64_t generation, std::vector<Document> documents) {
+    if (shard_capacity_ == 0) {
+        return;
+    }
+    Shard& shard = GetShard(key);
+    std::lock_guard guard(shard.mutex);
+    const auto it = shard.positions.find(key);
+    if (it != shard.positions.end()) {
+        if (it->second->generation > generation) {
+            return;
+        }
+        it->second->generation = generation;
+        it->second->documents = std::move(documents);
+        shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+        return;
+    }
+    if (shard.entries.size() == shard_capacity_) {
+        shard.positions.erase(shard.entries.back().key);
+        shard.entries.pop_back();
+    }
+    shard.entries.push_front({ key, generation, std::move(documents) });
+    shard.positions.emplace(key, shard.entries.begin());
+}
+
+QueryCache::Stats QueryCache::GetStats() const {
+    return { hits_.load(), misses_.load() };
+}
+
+QueryCache::Shard& QueryCache::GetShard(const std::string& key) {
+    return shards_[std::hash<std::string>{}(key) % SHARD_COUNT];
+}
\ No newline at end of file
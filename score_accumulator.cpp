@@ -0,0 +1,28 @@
+#include "score_accumulator.h"
+
+#include <algorithm>
+
+void ScoreAccumulator::Reset(uint32_t first_ordinal, uint32_t last_ordinal) {
+    const size_t slot_count = last_ordinal - first_ordinal;
+    const size_t word_count = (slot_count + 63) / 64;
+    if (stamps_.size() < slot_count) {
+        stamps_.resize(slot_count, 0);
+        scores_.resize(slot_count);
+    }
+    if (excluded_stamps_.size() < word_count) {
+        excluded_stamps_.resize(word_count, 0);
+        excluded_.resize(word_count);
+    }
+    if (++epoch_ == 0) {
+        std::fill(stamps_.begin(), stamps_.end(), 0);
+        std::fill(excluded_stamps_.begin(), excluded_stamps_.end(), 0);
+        epoch_ = 1;
+    }
+    first_ordinal_ = first_ordinal;
+    touched_.clear();
+}
+
+ScoreAccumulator& ScoreAccumulator::ForCurrentThread() {
+    thread_local ScoreAccumulator accumulator;
+    return accumulator;
+}
\ No newline at end of file
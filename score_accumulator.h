@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Dense relevance accumulator over a window of document ordinals. Slots and exclusion
+// bits carry the epoch they were written in, so Reset starts a new query without
+// clearing the arrays; they only grow, which keeps steady-state queries allocation free.
+class ScoreAccumulator {
+public:
+    // Starts a new query over ordinals in [first_ordinal, last_ordinal)
+    void Reset(uint32_t first_ordinal, uint32_t last_ordinal);
+
+    void Add(uint32_t ordinal, double score) {
+        const uint32_t slot = ordinal - first_ordinal_;
+        if (stamps_[slot] != epoch_) {
+            stamps_[slot] = epoch_;
+            scores_[slot] = 0.0;
+            touched_.push_back(ordinal);
+        }
+        scores_[slot] += score;
+    }
+
+    void Exclude(uint32_t ordinal) {
+        const uint32_t slot = ordinal - first_ordinal_;
+        const uint32_t word = slot / 64;
+        if (excluded_stamps_[word] != epoch_) {
+            excluded_stamps_[word] = epoch_;
+            excluded_[word] = 0;
+        }
+        excluded_[word] |= uint64_t{ 1 } << (slot % 64);
+    }
+
+    bool IsExcluded(uint32_t ordinal) const {
+        const uint32_t slot = ordinal - first_ordinal_;
+        const uint32_t word = slot / 64;
+        return excluded_stamps_[word] == epoch_ && (excluded_[word] >> (slot % 64) & 1);
+    }
+
+    // Calls callback(ordinal, score) for every scored ordinal that is not excluded
+    template <typename Callback>
+    void ForEachScore(Callback callback) const {
+        for (uint32_t ordinal : touched_) {
+            if (!IsExcluded(ordinal)) {
+                callback(ordinal, scores_[ordinal - first_ordinal_]);
+            }
+        }
+    }
+
+    // Returns the accumulator owned by the calling thread
+    static ScoreAccumulator& ForCurrentThread();
+
+private:
+    uint32_t first_ordinal_ = 0;
+    uint32_t epoch_ = 0;
+    std::vector<uint32_t> stamps_;
+    std::vector<double> scores_;
+    std::vector<uint32_t> touched_;
+    std::vector<uint32_t> excluded_stamps_;
+    std::vector<uint64_t> excluded_;
+};
\ No newline at end of file
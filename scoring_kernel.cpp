@@ -0,0 +1,54 @@
+#include "scoring_kernel.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SCORING_KERNEL_AVX2
+#include <immintrin.h>
+#endif
+
+namespace {
+
+void ComputeTermScoresScalar(const uint32_t* ordinals, const uint32_t* counts, size_t size, const double* inv_word_counts,
+    uint32_t first_ordinal, double inverse_document_freq, double* scores) {
+    for (size_t i = 0; i < size; ++i) {
+        scores[i] = counts[i] * inv_word_counts[ordinals[i] - first_ordinal] * inverse_document_freq;
+    }
+}
+
+#ifdef SCORING_KERNEL_AVX2
+__attribute__((target("avx2")))
+void ComputeTermScoresAvx2(const uint32_t* ordinals, const uint32_t* counts, size_t size, const double* inv_word_counts,
+    uint32_t first_ordinal, double inverse_document_freq, double* scores) {
+    // Segments hold far fewer than 2^31 documents, so slots fit the signed gather indices
+    const __m128i first = _mm_set1_epi32(static_cast<int>(first_ordinal));
+    const __m256d idf = _mm256_set1_pd(inverse_document_freq);
+    const __m256d all_lanes = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+    size_t i = 0;
+    for (; i + 4 <= size; i += 4) {
+        const __m128i slots = _mm_sub_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(ordinals + i)), first);
+        const __m256d inv_word_count = _mm256_mask_i32gather_pd(_mm256_setzero_pd(), inv_word_counts, slots, all_lanes, sizeof(double));
+        const __m256d count = _mm256_cvtepi32_pd(_mm_loadu_si128(reinterpret_cast<const __m128i*>(counts + i)));
+        // Same operation order as the scalar loop, so the scores match bit for bit
+        _mm256_storeu_pd(scores + i, _mm256_mul_pd(_mm256_mul_pd(count, inv_word_count), idf));
+    }
+    ComputeTermScoresScalar(ordinals + i, counts + i, size - i, inv_word_counts, first_ordinal, inverse_document_freq, scores + i);
+}
+#endif
+
+using ScoreFunction = void (*)(const uint32_t*, const uint32_t*, size_t, const double*, uint32_t, double, double*);
+
+ScoreFunction SelectScoreFunction() {
+#ifdef SCORING_KERNEL_AVX2
+    if (__builtin_cpu_supports("avx2")) {
+        return ComputeTermScoresAvx2;
+    }
+#endif
+    return ComputeTermScoresScalar;
+}
+
+}
+
+void ComputeTermScores(const uint32_t* ordinals, const uint32_t* counts, size_t size, const double* inv_word_counts,
+    uint32_t first_ordinal, double inverse_document_freq, double* scores) {
+    static const ScoreFunction score_function = SelectScoreFunction();
+    score_function(ordinals, counts, size, inv_word_counts, first_ordinal, inverse_document_freq, scores);
+}
\ No newline at end of file
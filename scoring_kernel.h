@@ -0,0 +1,10 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Computes the TF-IDF contributions of a decoded posting block:
+// scores[i] = counts[i] * inv_word_counts[ordinals[i] - first_ordinal] * inverse_document_freq.
+// Uses AVX2 gathers when the CPU supports them; results are the same on every path.
+void ComputeTermScores(const uint32_t* ordinals, const uint32_t* counts, size_t size, const double* inv_word_counts,
+    uint32_t first_ordinal, double inverse_document_freq, double* scores);
\ No newline at end of file
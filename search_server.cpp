@@ -1,7 +1,11 @@
 #include "search_server.h"
 
+#include <charconv>
+#include <unordered_map>
+#include <unordered_set>
+
 SearchServer::SearchServer(std::string_view stop_words_text)
-	: SearchServer(SplitIntoWords(std::string(stop_words_text)))
+	: SearchServer(SplitIntoWords(stop_words_text))
 {
 
 }
@@ -12,49 +16,467 @@ SearchServer::SearchServer(const std::string& stop_words_text)
 
 }
 
+SearchServer::~SearchServer() {
+	std::unique_lock lock(writer_mutex_);
+	merge_finished_.wait(lock, [this] { return !is_merging_; });
+	delete version_.load();
+	delete query_cache_.load();
+	EpochDomain::GetDefault().Reclaim();
+}
+
 void SearchServer::AddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings) {
-	if ((document_id < 0) || (documents_.count(document_id) > 0)) {
-		throw std::invalid_argument("Invalid document_id");
-	}
-	const auto& words = SplitIntoWordsNoStop(std::string{ document });
-	const double inv_word_count = 1.0 / words.size();
-	// std::cout << inv_word_count << std::endl;
-	documents_.emplace(document_id, DocumentData{ std::set(words.begin(), words.end()), SearchServer::ComputeAverageRating(ratings), status });
-	for (const std::string& word : words) {
-		std::string_view str(*documents_[document_id].content.find(word));
-		word_to_document_freqs_[str][document_id] += inv_word_count;
-		word_frequencies_to_document[document_id][str] += inv_word_count;
-	}
-	document_ids_.insert(document_id);
-}
-
-std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query, DocumentStatus status) const {
-	return FindTopDocuments(raw_query,
-		[status](int document_id, DocumentStatus document_status, int rating)
-		{
-			return document_status == status;
+	IndexDocuments({ { document_id, document, status, &ratings } });
+}
+
+namespace {
+
+struct PartialPosting {
+	uint32_t ordinal;
+	uint32_t count;
+	double term_freq;
+	size_t first_position;
+};
+
+// Index of a contiguous run of the documents passed to IndexDocuments, built by one task.
+// Terms get ids local to the part until they are interned into the shared dictionary.
+struct PartialIndex {
+	std::unordered_map<std::string_view, uint32_t> local_ids;
+	std::vector<std::string_view> words;
+	std::vector<std::vector<PartialPosting>> postings;
+	// Word positions of the postings, when the positional index is enabled
+	std::vector<uint32_t> positions;
+	std::vector<std::pair<uint32_t, double>> document_terms;
+	std::vector<size_t> document_term_ends;
+	std::vector<TermId> term_ids;
+};
+
+struct PartialTerm {
+	TermId term_id;
+	uint32_t part;
+	uint32_t local_id;
+};
+
+// Parses what follows the closing quote of a phrase: nothing, or ~ and the slop
+uint32_t ParsePhraseSlop(std::string_view text) {
+	uint32_t slop = 0;
+	if (text.empty()) {
+		return slop;
+	}
+	const char* end = text.data() + text.size();
+	const auto [parsed_end, error] = std::from_chars(text.data() + 1, end, slop);
+	if (text[0] != '~' || error != std::errc() || parsed_end != end) {
+		throw std::invalid_argument("Phrase slop " + std::string(text) + " is invalid");
+	}
+	return slop;
+}
+
+}
+
+void SearchServer::IndexDocuments(std::vector<DocumentInput> documents) {
+	// Segments keep their documents ordered by status
+	std::stable_sort(documents.begin(), documents.end(), [](const DocumentInput& lhs, const DocumentInput& rhs) {
+		return lhs.status < rhs.status;
 		});
+	{
+		std::lock_guard guard(writer_mutex_);
+		std::set<int> new_document_ids;
+		for (const DocumentInput& document : documents) {
+			if ((document.id < 0) || (document_ids_.count(document.id) > 0) || !new_document_ids.insert(document.id).second) {
+				throw std::invalid_argument("Invalid document_id");
+			}
+		}
+		if (documents.size() > std::numeric_limits<uint32_t>::max() - next_ordinal_) {
+			throw std::length_error("Too many documents");
+		}
+		if (documents.empty()) {
+			return;
+		}
+		const uint32_t first_ordinal = next_ordinal_;
+		const bool has_positions = version_.load()->has_positions;
+
+		ThreadPool& thread_pool = *thread_pool_;
+		const size_t part_count = std::min(documents.size(), thread_pool.GetParallelism() * 4);
+		const auto get_part_begin = [&](size_t part) {
+			return part * documents.size() / part_count;
+		};
+		std::vector<PartialIndex> parts(part_count);
+		DocumentColumns document_data;
+		document_data.resize(documents.size());
+		std::vector<std::shared_ptr<WordFrequencies>> word_frequencies(documents.size());
+
+		thread_pool.ParallelFor(part_count, [&](size_t part_index) {
+			PartialIndex& part = parts[part_index];
+			std::vector<std::string_view> words;
+			// (local id, position) of every word, positions counting non-stop words only
+			std::vector<std::pair<uint32_t, uint32_t>> word_ids;
+			for (size_t i = get_part_begin(part_index); i < get_part_begin(part_index + 1); ++i) {
+				const DocumentInput& document = documents[i];
+				SplitIntoWordsNoStop(document.text, words);
+				const double inv_word_count = 1.0 / words.size();
+				const uint32_t ordinal = first_ordinal + static_cast<uint32_t>(i);
+
+				word_ids.clear();
+				for (uint32_t position = 0; position < words.size(); ++position) {
+					const auto [it, inserted] = part.local_ids.emplace(words[position], static_cast<uint32_t>(part.words.size()));
+					if (inserted) {
+						part.words.push_back(words[position]);
+						part.postings.emplace_back();
+					}
+					word_ids.emplace_back(it->second, position);
+				}
+				std::sort(word_ids.begin(), word_ids.end());
+				for (auto it = word_ids.begin(); it != word_ids.end();) {
+					const uint32_t local_id = it->first;
+					const auto run_end = std::find_if(it, word_ids.end(), [local_id](const auto& word_id) {
+						return word_id.first != local_id;
+						});
+					const uint32_t count = static_cast<uint32_t>(run_end - it);
+					const double term_freq = count * inv_word_count;
+					part.postings[local_id].push_back({ ordinal, count, term_freq, part.positions.size() });
+					if (has_positions) {
+						for (; it != run_end; ++it) {
+							part.positions.push_back(it->second);
+						}
+					}
+					part.document_terms.emplace_back(local_id, term_freq);
+					it = run_end;
+				}
+				part.document_term_ends.push_back(part.document_terms.size());
+				document_data.ids[i] = document.id;
+				document_data.ratings[i] = ComputeAverageRating(*document.ratings);
+				document_data.statuses[i] = document.status;
+				document_data.inv_word_counts[i] = inv_word_count;
+				word_frequencies[i] = std::make_shared<WordFrequencies>();
+			}
+			});
+
+		// Only the dictionary is shared between parts, so interning is the one sequential step
+		std::vector<PartialTerm> partial_terms;
+		for (uint32_t part_index = 0; part_index < part_count; ++part_index) {
+			PartialIndex& part = parts[part_index];
+			part.term_ids.reserve(part.words.size());
+			for (uint32_t local_id = 0; local_id < part.words.size(); ++local_id) {
+				part.term_ids.push_back(terms_.Intern(part.words[local_id]));
+				partial_terms.push_back({ part.term_ids.back(), part_index, local_id });
+			}
+		}
+
+		// Parts cover increasing ordinal ranges, so appending a term's parts in part order
+		// keeps its posting list sorted. Every task owns a disjoint range of terms.
+		std::stable_sort(partial_terms.begin(), partial_terms.end(), [](const PartialTerm& lhs, const PartialTerm& rhs) {
+			return lhs.term_id < rhs.term_id;
+			});
+		std::vector<TermId> term_ids;
+		std::vector<size_t> term_starts;
+		for (size_t i = 0; i < partial_terms.size(); ++i) {
+			if (i == 0 || partial_terms[i].term_id != partial_terms[i - 1].term_id) {
+				term_ids.push_back(partial_terms[i].term_id);
+				term_starts.push_back(i);
+			}
+		}
+		term_starts.push_back(partial_terms.size());
+		std::vector<PostingList> term_postings(term_ids.size());
+		std::vector<PositionList> term_positions(has_positions ? term_ids.size() : 0);
+		thread_pool.ParallelFor(part_count, [&](size_t range) {
+			const size_t range_end = (range + 1) * term_ids.size() / part_count;
+			for (size_t term_index = range * term_ids.size() / part_count; term_index < range_end; ++term_index) {
+				PostingList& postings = term_postings[term_index];
+				for (size_t i = term_starts[term_index]; i < term_starts[term_index + 1]; ++i) {
+					const PartialIndex& part = parts[partial_terms[i].part];
+					for (const PartialPosting& posting : part.postings[partial_terms[i].local_id]) {
+						postings.Append(posting.ordinal, posting.count, posting.term_freq);
+						if (has_positions) {
+							term_positions[term_index].Append(part.positions.data() + posting.first_position, posting.count);
+						}
+					}
+				}
+				postings.ShrinkToFit();
+				if (has_positions) {
+					term_positions[term_index].ShrinkToFit();
+				}
+			}
+			});
+
+		thread_pool.ParallelFor(part_count, [&](size_t part_index) {
+			const PartialIndex& part = parts[part_index];
+			const size_t part_begin = get_part_begin(part_index);
+			size_t term_begin = 0;
+			for (size_t i = 0; i < part.document_term_ends.size(); ++i) {
+				WordFrequencies& frequencies = *word_frequencies[part_begin + i];
+				for (size_t j = term_begin; j < part.document_term_ends[i]; ++j) {
+					const auto [local_id, term_freq] = part.document_terms[j];
+					frequencies.emplace(terms_.GetWord(part.term_ids[local_id]), term_freq);
+				}
+				term_begin = part.document_term_ends[i];
+			}
+			});
+
+		std::vector<std::pair<TermId, int64_t>> document_freq_changes;
+		document_freq_changes.reserve(term_ids.size());
+		for (size_t i = 0; i < term_ids.size(); ++i) {
+			document_freq_changes.emplace_back(term_ids[i], term_postings[i].size());
+		}
+		document_data.word_frequencies.assign(word_frequencies.begin(), word_frequencies.end());
+		auto segment = std::make_shared<const IndexSegment>(first_ordinal, std::move(document_data), std::move(term_ids), std::move(term_postings),
+			std::move(term_positions));
+		auto version = std::make_unique<IndexVersion>(*version_.load());
+		version->parts.push_back({ std::move(segment), nullptr });
+		version->document_freqs = version->document_freqs.WithChanges(std::move(document_freq_changes));
+		version->document_count += documents.size();
+		++version->generation;
+		PublishVersion(std::move(version));
+		document_ids_.insert(new_document_ids.begin(), new_document_ids.end());
+		next_ordinal_ += static_cast<uint32_t>(documents.size());
+	}
+	ScheduleMerge();
+}
+
+void SearchServer::EnablePositionalIndex() {
+	std::lock_guard guard(writer_mutex_);
+	const IndexVersion& current_version = *version_.load();
+	if (current_version.has_positions) {
+		return;
+	}
+	if (!current_version.parts.empty()) {
+		throw std::logic_error("Positional index has to be enabled before documents are added");
+	}
+	auto version = std::make_unique<IndexVersion>(current_version);
+	version->has_positions = true;
+	PublishVersion(std::move(version));
+}
+
+std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query, DocumentStatus status, size_t result_count) const {
+	return FindTopDocuments(std::execution::seq, raw_query, status, result_count);
+}
+
+std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query, const DocumentFilter& filter, size_t result_count) const {
+	return FindTopDocuments(std::execution::seq, raw_query, filter, result_count);
 }
 
 std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query) const {
 	return FindTopDocuments(raw_query, DocumentStatus::ACTUAL);
 }
 
+std::vector<std::vector<Document>> SearchServer::FindTopDocumentsBatch(const std::vector<std::string>& raw_queries,
+	DocumentStatus status, size_t result_count) const {
+	static constexpr size_t MAX_CHUNK_SCRATCH_SIZE = 1 << 22;
+	static constexpr size_t MAX_RANGE_LENGTH = 1 << 14;
+
+	struct TermUsage {
+		TermId term_id;
+		double inverse_document_freq;
+	};
+
+	// Terms of a chunk's queries; every query lists the indexes of its usages in term id order
+	struct QueryChunk {
+		std::vector<TermUsage> term_usages;
+		std::vector<std::vector<size_t>> plus_usages;
+		std::vector<std::vector<size_t>> minus_usages;
+	};
+
+	struct SearchRange {
+		size_t part_index;
+		uint32_t first_ordinal;
+		uint32_t last_ordinal;
+	};
+
+	const auto version = GetVersion();
+	const size_t query_count = raw_queries.size();
+	std::vector<std::vector<Document>> result(query_count);
+
+	std::vector<SearchRange> ranges;
+	for (size_t i = 0; i < version->parts.size(); ++i) {
+		const auto [status_begin, status_end] = version->parts[i].segment->GetStatusRange(status);
+		for (uint32_t first_ordinal = status_begin; first_ordinal < status_end;) {
+			const uint32_t last_ordinal = static_cast<uint32_t>(std::min<size_t>(status_end, first_ordinal + MAX_RANGE_LENGTH));
+			ranges.push_back({ i, first_ordinal, last_ordinal });
+			first_ordinal = last_ordinal;
+		}
+	}
+
+	// Queries are evaluated in chunks of consecutive queries, one chunk per task. A chunk
+	// holds its parsed queries, the live postings of all its terms in a range and a top-K
+	// heap per query, so chunks are cut where that scratch would exceed
+	// MAX_CHUNK_SCRATCH_SIZE. Within a chunk every posting list is decoded and scored once.
+	// The batch is parsed and evaluated one round of chunks at a time, so scratch memory
+	// does not grow with the batch.
+	const size_t task_count = thread_pool_->GetParallelism();
+	const size_t max_chunk_query_count = std::max<size_t>((query_count + task_count - 1) / task_count, 1);
+	std::unordered_set<TermId> chunk_terms;
+	const auto get_scratch_size = [&](const Query& query) {
+		const size_t term_count = query.plus_terms.size() + query.minus_terms.size();
+		size_t scratch_size = sizeof(Query) + sizeof(TopDocuments) + result_count * sizeof(Document)
+			+ 2 * sizeof(std::vector<size_t>) + term_count * (2 * sizeof(TermId) + sizeof(size_t));
+		for (const auto* terms : { &query.plus_terms, &query.minus_terms }) {
+			for (TermId term_id : *terms) {
+				if (chunk_terms.count(term_id) == 0) {
+					const size_t posting_count = std::min(version->document_freqs.Get(term_id), MAX_RANGE_LENGTH);
+					scratch_size += posting_count * (sizeof(uint32_t) + sizeof(double));
+				}
+			}
+		}
+		return scratch_size;
+	};
+
+	for (size_t next_query = 0; next_query < query_count;) {
+		const QueryArena::Scope arena_scope;
+		// First query of every chunk in the round, then the first query after the round
+		std::vector<size_t> chunk_begins;
+		std::vector<QueryChunk> chunks;
+		while (next_query < query_count && chunks.size() < task_count) {
+			chunk_begins.push_back(next_query);
+			chunk_terms.clear();
+			size_t chunk_scratch_size = 0;
+			// (term id, is minus, query index in the chunk)
+			std::vector<std::tuple<TermId, bool, size_t>> term_queries;
+			for (; next_query < query_count && next_query - chunk_begins.back() < max_chunk_query_count; ++next_query) {
+				const Query query = ParseQuery(raw_queries[next_query]);
+				// Queries with required terms or phrases are intersected on their own
+				if (!query.required_terms.empty()) {
+					result[next_query] = FindTopDocumentsForQuery(std::execution::seq, *version, query, DocumentFilter{ status }, result_count);
+					continue;
+				}
+				const size_t scratch_size = get_scratch_size(query);
+				if (next_query > chunk_begins.back() && chunk_scratch_size + scratch_size > MAX_CHUNK_SCRATCH_SIZE) {
+					// The query is parsed again as the first one of the next chunk
+					break;
+				}
+				chunk_scratch_size += scratch_size;
+				for (TermId term_id : query.plus_terms) {
+					chunk_terms.insert(term_id);
+					term_queries.emplace_back(term_id, false, next_query - chunk_begins.back());
+				}
+				for (TermId term_id : query.minus_terms) {
+					chunk_terms.insert(term_id);
+					term_queries.emplace_back(term_id, true, next_query - chunk_begins.back());
+				}
+			}
+			QueryChunk& chunk = chunks.emplace_back();
+			chunk.plus_usages.resize(next_query - chunk_begins.back());
+			chunk.minus_usages.resize(next_query - chunk_begins.back());
+			// Visiting terms in id order adds up every query's scores in the same order as ParseQuery does
+			std::sort(term_queries.begin(), term_queries.end());
+			for (const auto& [term_id, is_minus, query_index] : term_queries) {
+				if (chunk.term_usages.empty() || chunk.term_usages.back().term_id != term_id) {
+					chunk.term_usages.push_back({ term_id, ComputeWordInverseDocumentFreq(*version, term_id) });
+				}
+				(is_minus ? chunk.minus_usages : chunk.plus_usages)[query_index].push_back(chunk.term_usages.size() - 1);
+			}
+		}
+
+		thread_pool_->ParallelFor(chunks.size(), [&](size_t chunk_index) {
+			const QueryChunk& chunk = chunks[chunk_index];
+			if (chunk.term_usages.empty()) {
+				return;
+			}
+			std::vector<TopDocuments> top_documents(chunk.plus_usages.size(), TopDocuments(result_count));
+			ScoreAccumulator& accumulator = ScoreAccumulator::ForCurrentThread();
+			// Live postings of every term in the range; usage i owns [usage_ends[i - 1], usage_ends[i])
+			std::vector<uint32_t> ordinals;
+			std::vector<double> scores;
+			std::vector<size_t> usage_ends(chunk.term_usages.size());
+			PostingList::DecodedBlock block;
+			double block_scores[PostingList::BLOCK_SIZE];
+			for (const auto& [part_index, first_ordinal, last_ordinal] : ranges) {
+				const IndexPart& part = version->parts[part_index];
+				const IndexSegment& segment = *part.segment;
+				ordinals.clear();
+				scores.clear();
+				for (size_t i = 0; i < chunk.term_usages.size(); ++i) {
+					const PostingList* postings = segment.FindPostings(chunk.term_usages[i].term_id);
+					if (postings != nullptr) {
+						auto cursor = postings->GetCursor();
+						cursor.SkipTo(first_ordinal);
+						while (!cursor.IsEnd() && cursor.GetOrdinal() < last_ordinal) {
+							cursor.ReadBlock(last_ordinal, block);
+							ComputeTermScores(block.ordinals, block.counts, block.size, segment.GetInvWordCounts().data(),
+								segment.GetFirstOrdinal(), chunk.term_usages[i].inverse_document_freq, block_scores);
+							for (size_t j = 0; j < block.size; ++j) {
+								if (!part.IsDeleted(block.ordinals[j])) {
+									ordinals.push_back(block.ordinals[j]);
+									scores.push_back(block_scores[j]);
+								}
+							}
+						}
+					}
+					usage_ends[i] = ordinals.size();
+				}
+
+				for (size_t query_index = 0; query_index < chunk.plus_usages.size(); ++query_index) {
+					if (chunk.plus_usages[query_index].empty()) {
+						continue;
+					}
+					accumulator.Reset(first_ordinal, last_ordinal);
+					for (size_t usage : chunk.minus_usages[query_index]) {
+						for (size_t j = usage == 0 ? 0 : usage_ends[usage - 1]; j < usage_ends[usage]; ++j) {
+							accumulator.Exclude(ordinals[j]);
+						}
+					}
+					for (size_t usage : chunk.plus_usages[query_index]) {
+						for (size_t j = usage == 0 ? 0 : usage_ends[usage - 1]; j < usage_ends[usage]; ++j) {
+							if (!accumulator.IsExcluded(ordinals[j])) {
+								accumulator.Add(ordinals[j], scores[j]);
+							}
+						}
+					}
+					accumulator.ForEachScore([&](uint32_t ordinal, double relevance) {
+						top_documents[query_index].Push({ segment.GetDocumentId(ordinal), relevance, segment.GetRating(ordinal) });
+						});
+				}
+			}
+			for (size_t i = 0; i < chunk.plus_usages.size(); ++i) {
+				if (!chunk.plus_usages[i].empty()) {
+					result[chunk_begins[chunk_index] + i] = top_documents[i].ExtractSorted();
+				}
+			}
+			});
+	}
+	return result;
+}
+
 std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(std::string_view raw_query, int document_id) const {
 	return MatchDocument(std::execution::seq, raw_query, document_id);
 }
 
 
 void SearchServer::RemoveDocument(int document_id) {
-	if (word_frequencies_to_document.count(document_id) == 0) {
-		return;
-	}
-	document_ids_.erase(document_id);
-	documents_.erase(document_id);
-	for (const auto& [word, frequency] : word_frequencies_to_document.at(document_id)) {
-		word_to_document_freqs_.at(word).erase(document_id);
+	DeleteDocuments({ document_id });
+}
+
+void SearchServer::DeleteDocuments(std::vector<int> document_ids) {
+	std::sort(document_ids.begin(), document_ids.end());
+	document_ids.erase(std::unique(document_ids.begin(), document_ids.end()), document_ids.end());
+	{
+		std::lock_guard guard(writer_mutex_);
+		auto version = std::make_unique<IndexVersion>(*version_.load());
+		std::vector<std::vector<uint32_t>> part_ordinals(version->parts.size());
+		std::vector<int> removed_ids;
+		for (int document_id : document_ids) {
+			if (document_ids_.count(document_id) == 0) {
+				continue;
+			}
+			const auto [part_index, ordinal] = *FindDocument(*version, document_id);
+			part_ordinals[part_index].push_back(ordinal);
+			removed_ids.push_back(document_id);
+		}
+		if (removed_ids.empty()) {
+			return;
+		}
+		std::vector<std::pair<TermId, int64_t>> document_freq_changes;
+		for (size_t i = 0; i < part_ordinals.size(); ++i) {
+			if (!part_ordinals[i].empty()) {
+				version->parts[i] = version->parts[i].WithDeletedDocuments(part_ordinals[i], terms_, &document_freq_changes);
+			}
+		}
+		version->document_freqs = version->document_freqs.WithChanges(std::move(document_freq_changes));
+		version->document_count -= removed_ids.size();
+		++version->generation;
+		PublishVersion(std::move(version));
+		for (int document_id : removed_ids) {
+			document_ids_.erase(document_id);
+		}
 	}
-	word_frequencies_to_document.erase(document_id);
+	ScheduleMerge();
 }
 
 std::set<int>::iterator SearchServer::begin() {
@@ -66,20 +488,210 @@ std::set<int>::iterator SearchServer::end() {
 }
 
 int SearchServer::GetDocumentCount() const {
-	return static_cast<int>(documents_.size());
+	return static_cast<int>(GetVersion()->document_count);
+}
+
+std::map<std::string_view, double> SearchServer::GetWordFrequencies(int document_id) const {
+	const auto version = GetVersion();
+	const auto location = FindDocument(*version, document_id);
+	if (!location) {
+		return {};
+	}
+	return version->parts[location->first].segment->GetWordFrequencies(location->second);
+}
+
+void SearchServer::Save(const std::string& path) const {
+	// The snapshot holds a single segment without removed documents
+	const auto version = GetVersion();
+	const auto segment = MergeSegments({ version->parts.data(), version->parts.size() }, 0);
+	const TermId term_count = static_cast<TermId>(terms_.GetTermCount());
+
+	snapshot::Writer writer(path);
+	snapshot::Header header{};
+
+	const auto write_strings = [&writer](const auto& strings, snapshot::Section& offsets_section, snapshot::Section& chars_section) {
+		std::vector<uint64_t> offsets{ 0 };
+		std::string chars;
+		for (std::string_view word : strings) {
+			chars += word;
+			offsets.push_back(chars.size());
+		}
+		offsets_section = writer.WriteArray(offsets);
+		chars_section = writer.WriteArray(std::vector<char>(chars.begin(), chars.end()));
+	};
+	write_strings(stop_words_, header.stop_word_offsets, header.stop_word_chars);
+	std::vector<std::string_view> words;
+	for (TermId term_id = 0; term_id < term_count; ++term_id) {
+		words.push_back(terms_.GetWord(term_id));
+	}
+	write_strings(words, header.term_offsets, header.term_chars);
+
+	std::vector<snapshot::TermPostings> term_postings;
+	std::vector<PostingList::SkipEntry> blocks;
+	header.posting_bytes.offset = writer.Align();
+	const PostingList no_postings;
+	for (TermId term_id = 0; term_id < term_count; ++term_id) {
+		const size_t term_index = segment->FindTerm(term_id);
+		const PostingList& postings = term_index == IndexSegment::NO_TERM_INDEX ? no_postings : segment->GetPostings(term_index);
+		const auto bytes = postings.GetBytes();
+		const auto list_blocks = postings.GetBlocks();
+		term_postings.push_back({ header.posting_bytes.count, bytes.size(), blocks.size(),
+			static_cast<uint32_t>(list_blocks.size()), static_cast<uint32_t>(postings.size()), postings.GetMaxTermFreq() });
+		writer.Write(bytes.data(), bytes.size());
+		header.posting_bytes.count += bytes.size();
+		blocks.insert(blocks.end(), list_blocks.begin(), list_blocks.end());
+	}
+	header.posting_blocks = writer.WriteArray(blocks);
+	header.term_postings = writer.WriteArray(term_postings);
+
+	std::vector<snapshot::TermPositions> term_positions;
+	std::vector<uint32_t> position_blocks;
+	header.position_bytes.offset = writer.Align();
+	if (version->has_positions) {
+		const PositionList no_positions;
+		for (TermId term_id = 0; term_id < term_count; ++term_id) {
+			const size_t term_index = segment->FindTerm(term_id);
+			const PositionList& positions = term_index == IndexSegment::NO_TERM_INDEX ? no_positions : segment->GetPositions(term_index);
+			const auto bytes = positions.GetBytes();
+			const auto list_blocks = positions.GetBlockOffsets();
+			term_positions.push_back({ header.position_bytes.count, bytes.size(), position_blocks.size(), list_blocks.size() });
+			writer.Write(bytes.data(), bytes.size());
+			header.position_bytes.count += bytes.size();
+			position_blocks.insert(position_blocks.end(), list_blocks.begin(), list_blocks.end());
+		}
+	}
+	header.position_blocks = writer.WriteArray(position_blocks);
+	header.term_positions = writer.WriteArray(term_positions);
+
+	std::vector<int32_t> ordinal_document_ids;
+	std::vector<snapshot::DocumentRecord> documents;
+	std::vector<snapshot::WordFrequencyRecord> word_frequencies;
+	for (uint32_t ordinal = segment->GetFirstOrdinal(); ordinal < segment->GetEndOrdinal(); ++ordinal) {
+		const int document_id = segment->GetDocumentId(ordinal);
+		const WordFrequencies& document_word_frequencies = segment->GetWordFrequencies(ordinal);
+		ordinal_document_ids.push_back(document_id);
+		documents.push_back({ document_id, segment->GetRating(ordinal), static_cast<int32_t>(segment->GetStatus(ordinal)), ordinal,
+			segment->GetInvWordCounts()[ordinal - segment->GetFirstOrdinal()], word_frequencies.size(), document_word_frequencies.size() });
+		for (const auto& [word, term_freq] : document_word_frequencies) {
+			word_frequencies.push_back({ terms_.Find(word), 0, term_freq });
+		}
+	}
+	header.ordinal_document_ids = writer.WriteArray(ordinal_document_ids);
+	header.documents = writer.WriteArray(documents);
+	header.word_frequencies = writer.WriteArray(word_frequencies);
+	writer.Finish(header);
+}
+
+SearchServer SearchServer::Load(const std::string& path) {
+	return SearchServer(snapshot::Reader(path));
+}
+
+SearchServer::SearchServer(const snapshot::Reader& reader)
+	: SearchServer(reader.GetStopWords())
+{
+	const auto& header = reader.GetHeader();
+	std::vector<TermId> term_ids;
+	std::vector<PostingList> term_postings;
+	std::vector<PositionList> term_positions;
+	for (TermId term_id = 0; term_id < header.term_postings.count; ++term_id) {
+		if (terms_.InternExternal(reader.GetTerm(term_id)) != term_id) {
+			throw std::runtime_error("Invalid index snapshot: duplicate term");
+		}
+		PostingList postings = reader.GetPostings(term_id);
+		if (!postings.empty()) {
+			term_ids.push_back(term_id);
+			term_postings.push_back(std::move(postings));
+			if (reader.HasPositions()) {
+				term_positions.push_back(reader.GetPositions(term_id));
+			}
+		}
+	}
+
+	const auto document_ids = reader.GetArray<int32_t>(header.ordinal_document_ids);
+	const auto word_frequencies = reader.GetArray<snapshot::WordFrequencyRecord>(header.word_frequencies);
+	DocumentColumns documents;
+	documents.resize(document_ids.size());
+	for (const auto& document : reader.GetArray<snapshot::DocumentRecord>(header.documents)) {
+		if (!document_ids_.insert(document.id).second || documents.word_frequencies[document.ordinal]) {
+			throw std::runtime_error("Invalid index snapshot: duplicate document");
+		}
+		auto frequencies = std::make_shared<WordFrequencies>();
+		for (uint64_t i = 0; i < document.word_frequency_count; ++i) {
+			const auto& frequency = word_frequencies[document.first_word_frequency + i];
+			frequencies->emplace(terms_.GetWord(frequency.term_id), frequency.term_freq);
+		}
+		documents.ids[document.ordinal] = document.id;
+		documents.ratings[document.ordinal] = document.rating;
+		documents.statuses[document.ordinal] = static_cast<DocumentStatus>(document.status);
+		documents.inv_word_counts[document.ordinal] = document.inv_word_count;
+		documents.word_frequencies[document.ordinal] = std::move(frequencies);
+	}
+
+	// Ordinals without a record belonged to documents removed before the snapshot was
+	// written; their postings are gone, so they only need to be marked as removed. They take
+	// the status of the document before them to keep the documents ordered by status.
+	auto deletions = std::make_shared<SegmentDeletions>(documents.size());
+	std::vector<size_t> removed_documents;
+	const auto no_word_frequencies = std::make_shared<const WordFrequencies>();
+	for (size_t i = 0; i < documents.size(); ++i) {
+		if (!documents.word_frequencies[i]) {
+			documents.ids[i] = document_ids[i];
+			documents.statuses[i] = i > 0 ? documents.statuses[i - 1] : DocumentStatus::ACTUAL;
+			documents.word_frequencies[i] = no_word_frequencies;
+			removed_documents.push_back(i);
+		}
+	}
+	deletions->Add(std::move(removed_documents));
+	if (!std::is_sorted(documents.statuses.begin(), documents.statuses.end())) {
+		throw std::runtime_error("Invalid index snapshot: documents are not ordered by status");
+	}
+
+	std::vector<std::pair<TermId, int64_t>> document_freq_changes;
+	document_freq_changes.reserve(term_ids.size());
+	for (size_t i = 0; i < term_ids.size(); ++i) {
+		document_freq_changes.emplace_back(term_ids[i], term_postings[i].size());
+	}
+	auto version = std::make_unique<IndexVersion>();
+	version->document_freqs = version->document_freqs.WithChanges(std::move(document_freq_changes));
+	version->document_count = document_ids_.size();
+	version->has_positions = reader.HasPositions();
+	if (documents.size() > 0) {
+		next_ordinal_ = static_cast<uint32_t>(documents.size());
+		version->parts.push_back({ std::make_shared<const IndexSegment>(0, std::move(documents), std::move(term_ids), std::move(term_postings),
+			std::move(term_positions)), deletions->document_count > 0 ? std::move(deletions) : nullptr });
+	}
+	delete version_.exchange(version.release());
+	snapshot_file_ = reader.GetFile();
+}
+
+void SearchServer::SetThreadPool(ThreadPool& thread_pool) {
+	thread_pool_ = &thread_pool;
 }
 
-const std::map<std::string_view, double>& SearchServer::GetWordFrequencies(int document_id) const {
-	static std::map<std::string_view, double> result;
-	auto document_id_position = find(document_ids_.begin(), document_ids_.end(), document_id);
-	if (document_id_position == document_ids_.end()) {
-		return result;
+ThreadPool& SearchServer::GetThreadPool() const {
+	return *thread_pool_;
+}
+
+void SearchServer::EnableQueryCache(size_t capacity) {
+	if (const QueryCache* old_cache = query_cache_.exchange(new QueryCache(capacity))) {
+		EpochDomain::GetDefault().Retire(old_cache);
 	}
-	return word_frequencies_to_document.at(document_id);
+}
+
+void SearchServer::DisableQueryCache() {
+	if (const QueryCache* old_cache = query_cache_.exchange(nullptr)) {
+		EpochDomain::GetDefault().Retire(old_cache);
+	}
+}
+
+QueryCache::Stats SearchServer::GetQueryCacheStats() const {
+	const EpochDomain::Guard guard;
+	const QueryCache* query_cache = query_cache_.load();
+	return query_cache ? query_cache->GetStats() : QueryCache::Stats{};
 }
 
 bool SearchServer::IsStopWord(std::string_view word) const {
-	return stop_words_.count(word) > 0;
+	return stop_words_.Contains(word);
 }
 
 bool SearchServer::IsValidWord(std::string_view word) {
@@ -88,31 +700,99 @@ bool SearchServer::IsValidWord(std::string_view word) {
 		});
 }
 
-std::vector<std::string> SearchServer::SplitIntoWordsNoStop(const std::string& text) const {
-	std::vector<std::string> words;
-	for (const std::string& word : SplitIntoWords(text)) {
-		if (!IsValidWord(word)) {
-			throw std::invalid_argument("Word " + word + " is invalid");
-		}
-		if (!IsStopWord(word)) {
-			words.push_back(word);
-		}
+void SearchServer::SplitIntoWordsNoStop(std::string_view text, std::vector<std::string_view>& words) const {
+	if (!SplitIntoWords(text, words)) {
+		const auto invalid_word = std::find_if_not(words.begin(), words.end(), IsValidWord);
+		throw std::invalid_argument("Word " + std::string(*invalid_word) + " is invalid");
 	}
-	return words;
+	words.erase(std::remove_if(words.begin(), words.end(), [this](std::string_view word) { return IsStopWord(word); }), words.end());
 }
 
 SearchServer::Query SearchServer::ParseQuery(std::string_view text) const {
+	thread_local std::vector<std::string_view> words;
+	if (!SplitIntoWords(text, words)) {
+		const auto invalid_word = std::find_if_not(words.begin(), words.end(), IsValidWord);
+		throw std::invalid_argument("Query word " + std::string(*invalid_word) + " is invalid");
+	}
 	Query result;
-	for (std::string_view word : SplitIntoWordsView(text)) {
-		const auto& query_word = ParseQueryWord(word);
-		if (!query_word.is_stop) {
-			if (query_word.is_minus) {
-				result.minus_words.insert(query_word.data);
+	// Terms of all phrases in order, and the end of every phrase in it with its slop
+	std::pmr::vector<TermId> phrase_words(&QueryArena::ForCurrentThread());
+	std::pmr::vector<std::pair<size_t, uint32_t>> phrase_ends(&QueryArena::ForCurrentThread());
+	bool is_in_phrase = false;
+	for (std::string_view word : words) {
+		if (!is_in_phrase && !word.empty() && word[0] == '"') {
+			is_in_phrase = true;
+			word.remove_prefix(1);
+		}
+		const size_t quote = word.find('"');
+		if (quote != std::string_view::npos && !is_in_phrase) {
+			throw std::invalid_argument("Query word " + std::string(word) + " is invalid");
+		}
+		if (is_in_phrase) {
+			const std::string_view phrase_word = word.substr(0, quote);
+			if (!phrase_word.empty()) {
+				const auto query_word = ParseQueryWord(phrase_word);
+				if (query_word.is_minus || query_word.is_required) {
+					throw std::invalid_argument("Phrase word " + std::string(phrase_word) + " is invalid");
+				}
+				// Stop words are not indexed, so they are left out of positions on both sides
+				if (!query_word.is_stop) {
+					phrase_words.push_back(terms_.Find(query_word.data));
+				}
 			}
-			else {
-				result.plus_words.insert(query_word.data);
+			if (quote != std::string_view::npos) {
+				is_in_phrase = false;
+				const uint32_t slop = ParsePhraseSlop(word.substr(quote + 1));
+				if (phrase_ends.empty() ? !phrase_words.empty() : phrase_ends.back().first < phrase_words.size()) {
+					phrase_ends.emplace_back(phrase_words.size(), slop);
+				}
 			}
+			continue;
+		}
+		const auto query_word = ParseQueryWord(word);
+		if (query_word.is_stop) {
+			continue;
+		}
+		const TermId term_id = terms_.Find(query_word.data);
+		if (query_word.is_required) {
+			result.required_terms.push_back(term_id);
+		}
+		// Words missing from the dictionary can neither match nor exclude anything, but an
+		// unknown required word stays among the required terms, which then match nothing
+		if (term_id == TermDictionary::NO_TERM) {
+			continue;
+		}
+		if (query_word.is_minus) {
+			result.minus_terms.push_back(term_id);
 		}
+		else {
+			result.plus_terms.push_back(term_id);
+		}
+	}
+	if (is_in_phrase) {
+		throw std::invalid_argument("Query phrase is not closed");
+	}
+
+	// Likewise an unknown phrase word stays in the phrase
+	result.required_terms.insert(result.required_terms.end(), phrase_words.begin(), phrase_words.end());
+	for (TermId term_id : phrase_words) {
+		if (term_id != TermDictionary::NO_TERM) {
+			result.plus_terms.push_back(term_id);
+		}
+	}
+	for (auto* terms : { &result.plus_terms, &result.minus_terms, &result.required_terms }) {
+		std::sort(terms->begin(), terms->end());
+		terms->erase(std::unique(terms->begin(), terms->end()), terms->end());
+	}
+	size_t phrase_begin = 0;
+	for (const auto& [phrase_end, slop] : phrase_ends) {
+		Phrase& phrase = result.phrases.emplace_back();
+		phrase.slop = slop;
+		for (size_t i = phrase_begin; i < phrase_end; ++i) {
+			const auto it = std::lower_bound(result.required_terms.begin(), result.required_terms.end(), phrase_words[i]);
+			phrase.words.push_back(static_cast<uint32_t>(it - result.required_terms.begin()));
+		}
+		phrase_begin = phrase_end;
 	}
 	return result;
 }
@@ -122,17 +802,16 @@ SearchServer::QueryWord SearchServer::ParseQueryWord(std::string_view text) cons
 		throw std::invalid_argument("Query word is empty");
 	}
 	std::string_view word = text;
-	bool is_minus = false;
-	if (word[0] == '-') {
-		is_minus = true;
+	const bool is_minus = word[0] == '-';
+	const bool is_required = word[0] == '+';
+	if (is_minus || is_required) {
 		word = word.substr(1);
 	}
-	if (word.empty() || word[0] == '-' || !IsValidWord(std::string{ word })) {
-		std::string error_text(word);
-		throw std::invalid_argument("Query word " + error_text + " is invalid");
+	if (word.empty() || word[0] == '-' || word[0] == '+') {
+		throw std::invalid_argument("Query word " + std::string(word) + " is invalid");
 	}
 
-	return { word, is_minus, IsStopWord(std::string { word }) };
+	return { word, is_minus, is_required, IsStopWord(word) };
 }
 
 int SearchServer::ComputeAverageRating(const std::vector<int>& ratings) {
@@ -146,6 +825,287 @@ int SearchServer::ComputeAverageRating(const std::vector<int>& ratings) {
 	return rating_sum / static_cast<int>(ratings.size());
 }
 
-double SearchServer::ComputeWordInverseDocumentFreq(const std::string& word) const {
-	return log(GetDocumentCount() * 1.0 / word_to_document_freqs_.at(word).size());
+double SearchServer::ComputeWordInverseDocumentFreq(const IndexVersion& version, TermId term_id) {
+	return log(version.document_count * 1.0 / version.document_freqs.Get(term_id));
+}
+
+std::pmr::vector<double> SearchServer::ComputeInverseDocumentFreqs(const IndexVersion& version, const Query& query) {
+	std::pmr::vector<double> inverse_document_freqs(&QueryArena::ForCurrentThread());
+	inverse_document_freqs.reserve(query.plus_terms.size());
+	for (TermId term_id : query.plus_terms) {
+		inverse_document_freqs.push_back(ComputeWordInverseDocumentFreq(version, term_id));
+	}
+	return inverse_document_freqs;
+}
+
+SearchServer::SegmentQuery SearchServer::ResolveQuery(const IndexSegment& segment, const Query& query) {
+	SegmentQuery result;
+	for (TermId term_id : query.plus_terms) {
+		result.plus_postings.push_back(segment.FindPostings(term_id));
+	}
+	for (TermId term_id : query.minus_terms) {
+		result.minus_postings.push_back(segment.FindPostings(term_id));
+	}
+	for (TermId term_id : query.required_terms) {
+		const size_t term_index = segment.FindTerm(term_id);
+		const bool has_term = term_index != IndexSegment::NO_TERM_INDEX;
+		result.required_postings.push_back(has_term ? &segment.GetPostings(term_index) : nullptr);
+		result.required_positions.push_back(has_term && segment.HasPositions() ? &segment.GetPositions(term_index) : nullptr);
+		const auto plus_term = std::lower_bound(query.plus_terms.begin(), query.plus_terms.end(), term_id);
+		result.required_plus_indexes.push_back(static_cast<size_t>(plus_term - query.plus_terms.begin()));
+	}
+	result.phrases = { query.phrases.data(), query.phrases.size() };
+	return result;
+}
+
+std::optional<uint32_t> SearchServer::ComputePhraseDistance(const Phrase& phrase,
+	const std::pmr::vector<std::pmr::vector<uint32_t>>& word_positions, std::pmr::vector<size_t>& next) {
+	// A match starting at p has word k at p + k, so the distance of a choice of positions is
+	// the spread of their position - k values. The spread ignores the order of the words, so
+	// swapped words cost slop rather than failing the match. The smallest spread is found by
+	// repeatedly advancing the word whose value is lowest.
+	next.assign(phrase.words.size(), 0);
+	int64_t min_spread = std::numeric_limits<int64_t>::max();
+	while (min_spread > 0) {
+		int64_t low = std::numeric_limits<int64_t>::max();
+		int64_t high = std::numeric_limits<int64_t>::min();
+		size_t low_word = 0;
+		for (size_t k = 0; k < phrase.words.size(); ++k) {
+			const int64_t value = int64_t{ word_positions[phrase.words[k]][next[k]] } - static_cast<int64_t>(k);
+			if (value < low) {
+				low = value;
+				low_word = k;
+			}
+			high = std::max(high, value);
+		}
+		min_spread = std::min(min_spread, high - low);
+		if (++next[low_word] == word_positions[phrase.words[low_word]].size()) {
+			break;
+		}
+	}
+	if (min_spread > phrase.slop) {
+		return std::nullopt;
+	}
+	return static_cast<uint32_t>(min_spread);
+}
+
+std::vector<SearchServer::TopDocuments>& SearchServer::GetRangeTopDocuments(size_t range_count, size_t max_count) {
+	thread_local std::vector<TopDocuments> range_top_documents;
+	while (range_top_documents.size() < range_count) {
+		range_top_documents.emplace_back(max_count);
+	}
+	for (size_t i = 0; i < range_count; ++i) {
+		range_top_documents[i].Reset(max_count);
+	}
+	return range_top_documents;
+}
+
+std::pmr::vector<uint32_t> SearchServer::SplitOrdinalsByPostings(uint32_t first_ordinal, uint32_t last_ordinal, const SegmentQuery& query,
+	size_t max_part_count) {
+	static constexpr size_t MIN_BLOCKS_PER_PART = 8;
+
+	// Posting blocks hold the same number of postings, so splitting at block boundaries
+	// gives every part a similar amount of decoding and scoring work
+	QueryArena& arena = QueryArena::ForCurrentThread();
+	std::pmr::vector<uint32_t> block_ends(&arena);
+	for (const auto* postings_lists : { &query.plus_postings, &query.minus_postings }) {
+		for (const PostingList* postings : *postings_lists) {
+			if (postings == nullptr) {
+				continue;
+			}
+			for (const auto& block : postings->GetBlocks()) {
+				if (block.last_ordinal >= first_ordinal && block.last_ordinal < last_ordinal) {
+					block_ends.push_back(block.last_ordinal + 1);
+				}
+			}
+		}
+	}
+	const size_t part_count = std::clamp<size_t>(block_ends.size() / MIN_BLOCKS_PER_PART, 1, max_part_count);
+
+	std::pmr::vector<uint32_t> part_bounds({ first_ordinal }, &arena);
+	if (part_count > 1) {
+		std::sort(block_ends.begin(), block_ends.end());
+		for (size_t i = 1; i < part_count; ++i) {
+			const uint32_t bound = block_ends[i * block_ends.size() / part_count];
+			if (bound > part_bounds.back()) {
+				part_bounds.push_back(bound);
+			}
+		}
+	}
+	if (part_bounds.back() < last_ordinal) {
+		part_bounds.push_back(last_ordinal);
+	}
+	return part_bounds;
+}
+
+std::string SearchServer::MakeQueryCacheKey(char policy_tag, const Query& query, const DocumentFilter& filter, size_t result_count) {
+	std::string key(1, policy_tag);
+	const auto append = [&key](auto value) {
+		key.append(reinterpret_cast<const char*>(&value), sizeof(value));
+	};
+	append(filter.status.has_value());
+	append(filter.status.value_or(DocumentStatus::ACTUAL));
+	append(filter.min_rating);
+	append(filter.max_rating);
+	append(result_count);
+	append(query.plus_terms.size());
+	append(query.minus_terms.size());
+	append(query.required_terms.size());
+	for (const auto* terms : { &query.plus_terms, &query.minus_terms, &query.required_terms }) {
+		for (TermId term_id : *terms) {
+			append(term_id);
+		}
+	}
+	for (const Phrase& phrase : query.phrases) {
+		append(phrase.slop);
+		append(phrase.words.size());
+		for (uint32_t word : phrase.words) {
+			append(word);
+		}
+	}
+	return key;
+}
+
+SearchServer::VersionPin SearchServer::GetVersion() const {
+	return VersionPin(version_);
+}
+
+void SearchServer::PublishVersion(std::unique_ptr<const IndexVersion> version) {
+	// Readers that loaded the old version keep using it until they leave their guards
+	EpochDomain::GetDefault().Retire(version_.exchange(version.release()));
+}
+
+std::optional<std::pair<size_t, uint32_t>> SearchServer::FindDocument(const IndexVersion& version, int document_id) {
+	// A re-added document is newer than the removed copies of it
+	for (size_t i = version.parts.size(); i-- > 0;) {
+		if (const auto ordinal = version.parts[i].FindDocument(document_id)) {
+			return std::pair{ i, *ordinal };
+		}
+	}
+	return std::nullopt;
+}
+
+std::optional<std::pair<size_t, size_t>> SearchServer::PickMergeRange(const IndexVersion& version) {
+	static constexpr size_t MAX_PART_COUNT = 8 * MERGE_FACTOR;
+
+	// A segment's tier is the number of digits of its live document count in base MERGE_FACTOR.
+	// Merging MERGE_FACTOR neighbours of one tier gives a segment of the next tier, so every
+	// document is rewritten about log(document count) times and few segments remain.
+	const auto get_tier = [](const IndexPart& part) {
+		size_t tier = 0;
+		for (size_t count = part.GetLiveDocumentCount(); count >= MERGE_FACTOR; count /= MERGE_FACTOR) {
+			++tier;
+		}
+		return tier;
+	};
+	const auto& parts = version.parts;
+	for (size_t end = parts.size(); end >= MERGE_FACTOR; --end) {
+		const size_t tier = get_tier(parts[end - 1]);
+		if (std::all_of(parts.begin() + (end - MERGE_FACTOR), parts.begin() + end,
+			[&](const IndexPart& part) { return get_tier(part) == tier; })) {
+			return std::pair{ end - MERGE_FACTOR, end };
+		}
+	}
+	// Segments that lost at least half of their documents are rewritten on their own, so
+	// postings of removed documents do not linger in segments that rarely get merged
+	for (size_t i = 0; i < parts.size(); ++i) {
+		const IndexPart& part = parts[i];
+		if (part.deletions && part.deletions->document_count * 2 >= part.segment->GetDocumentCount()) {
+			return std::pair{ i, i + 1 };
+		}
+	}
+	// Mixed tiers never line up in some add and remove patterns; cap the segment count by
+	// merging the smallest neighbours
+	if (parts.size() > MAX_PART_COUNT) {
+		size_t best_begin = 0;
+		size_t best_count = std::numeric_limits<size_t>::max();
+		for (size_t begin = 0; begin + MERGE_FACTOR <= parts.size(); ++begin) {
+			size_t count = 0;
+			for (size_t i = begin; i < begin + MERGE_FACTOR; ++i) {
+				count += parts[i].GetLiveDocumentCount();
+			}
+			if (count < best_count) {
+				best_begin = begin;
+				best_count = count;
+			}
+		}
+		return std::pair{ best_begin, best_begin + MERGE_FACTOR };
+	}
+	return std::nullopt;
+}
+
+void SearchServer::ScheduleMerge() {
+	{
+		std::lock_guard guard(writer_mutex_);
+		if (is_merging_ || !PickMergeRange(*version_.load())) {
+			return;
+		}
+		is_merging_ = true;
+	}
+	thread_pool_->Submit([this] { RunMerges(); });
+}
+
+void SearchServer::RunMerges() {
+	try {
+		while (true) {
+			std::vector<IndexPart> inputs;
+			std::pair<size_t, size_t> range;
+			{
+				std::lock_guard guard(writer_mutex_);
+				const IndexVersion& version = *version_.load();
+				const auto picked = PickMergeRange(version);
+				if (!picked) {
+					is_merging_ = false;
+					merge_finished_.notify_all();
+					return;
+				}
+				range = *picked;
+				inputs.assign(version.parts.begin() + range.first, version.parts.begin() + range.second);
+			}
+			IndexPart merged{ MergeSegments({ inputs.data(), inputs.size() }, inputs[0].segment->GetFirstOrdinal()), nullptr };
+
+			std::lock_guard guard(writer_mutex_);
+			// Only merges replace parts, so the inputs are still in place. Documents removed
+			// while the merge ran are live in the merged segment and get removed there.
+			auto new_version = std::make_unique<IndexVersion>(*version_.load());
+			std::vector<uint32_t> deleted_ordinals;
+			const bool has_removals = !std::equal(inputs.begin(), inputs.end(), new_version->parts.begin() + range.first,
+				[](const IndexPart& before, const IndexPart& now) { return before.deletions == now.deletions; });
+			if (has_removals) {
+				// The merge numbered the live documents by status and then in part order
+				uint32_t merged_ordinal = merged.segment->GetFirstOrdinal();
+				for (size_t status = 0; status < IndexSegment::STATUS_COUNT; ++status) {
+					for (size_t i = range.first; i < range.second; ++i) {
+						const IndexPart& before = inputs[i - range.first];
+						const IndexPart& now = new_version->parts[i];
+						const auto [range_begin, range_end] = before.segment->GetStatusRange(static_cast<DocumentStatus>(status));
+						for (uint32_t ordinal = range_begin; ordinal < range_end; ++ordinal) {
+							if (before.IsDeleted(ordinal)) {
+								continue;
+							}
+							if (now.IsDeleted(ordinal)) {
+								deleted_ordinals.push_back(merged_ordinal);
+							}
+							++merged_ordinal;
+						}
+					}
+				}
+			}
+			if (!deleted_ordinals.empty()) {
+				merged = merged.WithDeletedDocuments(deleted_ordinals, terms_);
+			}
+			auto& parts = new_version->parts;
+			parts.erase(parts.begin() + range.first, parts.begin() + range.second);
+			if (merged.segment->GetDocumentCount() > 0) {
+				parts.insert(parts.begin() + range.first, std::move(merged));
+			}
+			PublishVersion(std::move(new_version));
+		}
+	}
+	catch (...) {
+		// A failed merge leaves the index as it was; the next change schedules another one
+		std::lock_guard guard(writer_mutex_);
+		is_merging_ = false;
+		merge_finished_.notify_all();
+	}
 }
@@ -1,17 +1,36 @@
 #pragma once
 
-#include "concurrent_map.h"
 #include "document.h"
+#include "epoch_domain.h"
+#include "index_segment.h"
+#include "index_snapshot.h"
+#include "position_list.h"
+#include "posting_list.h"
+#include "query_arena.h"
+#include "query_cache.h"
 #include "read_input_functions.h"
+#include "score_accumulator.h"
+#include "scoring_kernel.h"
+#include "stop_word_set.h"
 #include "string_processing.h"
+#include "term_dictionary.h"
+#include "thread_pool.h"
+#include "top_k.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cmath>
+#include <condition_variable>
 #include <map>
+#include <mutex>
+#include <optional>
 #include <string>
 #include <set>
 #include <vector>
+#include <limits>
 #include <list>
+#include <memory>
+#include <memory_resource>
 #include <utility>
 #include <stdexcept>
 #include <tuple>
@@ -19,9 +38,28 @@
 #include <future>
 #include <type_traits>
 #include <string_view>
+#include <iterator>
+
+namespace search_policy {
+
+// Block-Max WAND evaluator: returns the same documents as std::execution::seq,
+// but skips postings of documents that cannot make it into the top results. It pays off
+// for short queries whose rare words fill the top results early; on queries with more
+// than SearchServer::MAX_WAND_TERM_COUNT plus words almost every document stays a
+// candidate, so those fall back to the sequential evaluator.
+struct Wand {};
+
+inline constexpr Wand wand;
+
+}
 
 class SearchServer {
 public:
+	const static int MAX_RESULT_DOCUMENT_COUNT = 5;
+
+	// Longest query, in plus words, that search_policy::wand evaluates with WAND
+	static constexpr size_t MAX_WAND_TERM_COUNT = 6;
+
 	SearchServer(std::string_view stop_words_text);
 
 	SearchServer(const std::string& stop_words_text);
@@ -35,24 +73,63 @@ public:
 		}
 	}
 
+	// Waits for background merges to finish
+	~SearchServer();
+
+	// Documents may be added and removed while queries run. Every change publishes a new
+	// version of the index, and a query sees the version that was current when it started.
 	void AddDocument(int document_id, std::string_view, DocumentStatus status, const std::vector<int>& ratings);
 
+	// Adds (id, text, status, ratings) entries in one go: documents are tokenized in parallel
+	// into partial indexes that are then merged into one new segment. Ids are checked and
+	// words are validated before the index is changed.
+	template <typename DocumentRange>
+	void AddDocuments(const DocumentRange& documents);
+
+	// Records word positions of documents added from now on, which quoted phrases in queries
+	// need. Phrase words have to occur next to each other in order, not counting stop words.
+	// "words"~N is an unordered proximity window instead: some exact match position must have
+	// every word at most N positions after its place in it, so two swapped neighbours need ~2.
+	// Closer phrase matches score higher.
+	// Throws logic_error if the index already has documents.
+	void EnablePositionalIndex();
+
+	// Query words prefixed with + are required: only documents containing all of them match,
+	// and they are found by intersecting posting lists instead of scoring every posting
 	template <typename DocumentPredicate>
-	std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentPredicate document_predicate) const;
+	std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentPredicate document_predicate,
+		size_t result_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
+	std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentStatus status,
+		size_t result_count = MAX_RESULT_DOCUMENT_COUNT) const;
 
-	std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentStatus status) const;
+	// Applies the filter without calling a predicate per posting; a status filter skips the
+	// postings of documents with other statuses altogether
+	std::vector<Document> FindTopDocuments(std::string_view raw_query, const DocumentFilter& filter,
+		size_t result_count = MAX_RESULT_DOCUMENT_COUNT) const;
 
 	std::vector<Document> FindTopDocuments(std::string_view raw_query) const;
 
 	template <typename ExecutionPolicy, typename DocumentPredicate>
-	std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy, const std::string_view& raw_query, DocumentPredicate document_predicate) const;
+	std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy, const std::string_view& raw_query, DocumentPredicate document_predicate,
+		size_t result_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
+	template <typename ExecutionPolicy>
+	std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy, const std::string_view& raw_query, DocumentStatus status,
+		size_t result_count = MAX_RESULT_DOCUMENT_COUNT) const;
 
 	template <typename ExecutionPolicy>
-	std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy, const std::string_view& raw_query, DocumentStatus status) const;
+	std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy, const std::string_view& raw_query, const DocumentFilter& filter,
+		size_t result_count = MAX_RESULT_DOCUMENT_COUNT) const;
 
 	template <typename ExecutionPolicy>
 	std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy, const std::string_view& raw_query) const;
 
+	// Evaluates the queries together: each posting list is decoded once and its scores
+	// are scattered to every query using the term. Results match per-query FindTopDocuments.
+	std::vector<std::vector<Document>> FindTopDocumentsBatch(const std::vector<std::string>& raw_queries,
+		DocumentStatus status = DocumentStatus::ACTUAL, size_t result_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
 	std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(std::string_view, int document_id) const;
 
 	template<class ExecutionPolicy>
@@ -60,146 +137,413 @@ public:
 		std::string_view raw_query,
 		int document_id) const;
 
+	// Marks the document as removed in its segment's deletion bitmap; its postings are dropped
+	// when the segment is next merged or compacted
 	void RemoveDocument(int document_id);
 
 	template<class ExecutionPolicy>
 	void RemoveDocument(ExecutionPolicy&& policy, int document_id);
 
+	// Removes every listed document in one new index version. Unknown ids are skipped.
+	template <typename DocumentIdRange>
+	void RemoveDocuments(const DocumentIdRange& document_ids);
+
 	std::set<int>::iterator begin();
 
 	std::set<int>::iterator end();
 
 	int GetDocumentCount() const;
 
-	const std::map<std::string_view, double>& GetWordFrequencies(int document_id) const;
+	// Returns a copy: a concurrent removal or merge may free the segment that holds the
+	// document. The words stay valid for the lifetime of the server.
+	std::map<std::string_view, double> GetWordFrequencies(int document_id) const;
 
-private:
-	const static int MAX_RESULT_DOCUMENT_COUNT = 5;
+	// Writes the index to a versioned, checksummed binary file
+	void Save(const std::string& path) const;
 
-	struct DocumentData {
-		std::set<std::string> content;
-		int rating;
-		DocumentStatus status;
+	// Opens a file written by Save. Posting lists and dictionary words are used straight
+	// from the mapped pages, which stay mapped for the lifetime of the server.
+	static SearchServer Load(const std::string& path);
+
+	// Pool used by parallel queries and batch processing; it must outlive the server
+	void SetThreadPool(ThreadPool& thread_pool);
+
+	ThreadPool& GetThreadPool() const;
+
+	// Caches results of FindTopDocuments calls with a status or filter, keyed by the parsed query.
+	// Any AddDocument or RemoveDocument invalidates all cached results. The cache may be
+	// enabled, replaced or disabled while queries run; queries in flight finish with the
+	// cache they started with.
+	void EnableQueryCache(size_t capacity);
+
+	void DisableQueryCache();
+
+	QueryCache::Stats GetQueryCacheStats() const;
+
+private:
+	struct Phrase {
+		// Indexes into Query::required_terms in phrase order
+		std::pmr::vector<uint32_t> words{ &QueryArena::ForCurrentThread() };
+		uint32_t slop = 0;
 	};
 
+	// Query scratch lives in the calling thread's QueryArena. Required terms are the +words and
+	// phrase words; they are sorted and may include TermDictionary::NO_TERM for unknown words.
+	// The known ones are plus terms as well.
 	struct Query {
-		std::set<std::string_view> plus_words;
-		std::set<std::string_view> minus_words;
+		std::pmr::vector<TermId> plus_terms{ &QueryArena::ForCurrentThread() };
+		std::pmr::vector<TermId> minus_terms{ &QueryArena::ForCurrentThread() };
+		std::pmr::vector<TermId> required_terms{ &QueryArena::ForCurrentThread() };
+		std::pmr::vector<Phrase> phrases{ &QueryArena::ForCurrentThread() };
+	};
+
+	struct DocumentInput {
+		int id;
+		std::string_view text;
+		DocumentStatus status;
+		const std::vector<int>* ratings;
 	};
 
 	struct QueryWord {
 		std::string_view data;
 		bool is_minus;
+		bool is_required;
 		bool is_stop;
 	};
 
-	const std::set<std::string, std::less<>> stop_words_;
-	std::map<std::string_view, std::map<int, double>> word_to_document_freqs_;
-	std::map<int, DocumentData> documents_;
+	// Query terms resolved against one segment, nullptr where the segment lacks the term.
+	// Required terms also get their index among the plus terms, for the inverse document frequency.
+	struct SegmentQuery {
+		std::pmr::vector<const PostingList*> plus_postings{ &QueryArena::ForCurrentThread() };
+		std::pmr::vector<const PostingList*> minus_postings{ &QueryArena::ForCurrentThread() };
+		std::pmr::vector<const PostingList*> required_postings{ &QueryArena::ForCurrentThread() };
+		std::pmr::vector<const PositionList*> required_positions{ &QueryArena::ForCurrentThread() };
+		std::pmr::vector<size_t> required_plus_indexes{ &QueryArena::ForCurrentThread() };
+		ArrayView<Phrase> phrases;
+	};
+
+	// Index as seen by queries. Segments are ordered by ordinal; new documents go to new
+	// segments at the end, and runs of adjacent segments are merged in the background.
+	struct IndexVersion {
+		std::vector<IndexPart> parts;
+		DocumentFreqTable document_freqs;
+		size_t document_count = 0;
+		uint64_t generation = 0;
+		bool has_positions = false;
+	};
+
+	// Keeps the version that was current when it was taken from being deleted while in scope
+	class VersionPin {
+	public:
+		explicit VersionPin(const std::atomic<const IndexVersion*>& version)
+			: version_(version.load())
+		{
+		}
+
+		const IndexVersion& operator*() const {
+			return *version_;
+		}
+
+		const IndexVersion* operator->() const {
+			return version_;
+		}
+
+	private:
+		EpochDomain::Guard guard_;
+		const IndexVersion* version_;
+	};
+
+	// Number of adjacent segments of the same size tier that get merged into one
+	static constexpr size_t MERGE_FACTOR = 8;
+
+	static constexpr double RELEVANCE_EPSILON = 1e-6;
+
+	struct IsMoreRelevant {
+		bool operator()(const Document& lhs, const Document& rhs) const {
+			if (std::abs(lhs.relevance - rhs.relevance) < RELEVANCE_EPSILON) {
+				return lhs.rating > rhs.rating;
+			}
+			return lhs.relevance > rhs.relevance;
+		}
+	};
+
+	using TopDocuments = TopKCollector<Document, IsMoreRelevant>;
+
+	const StopWordSet stop_words_;
+	TermDictionary terms_;
 	std::set<int> document_ids_;
-	std::map<int, std::map<std::string_view, double>> word_frequencies_to_document;
+	uint32_t next_ordinal_ = 0;
+	// Serializes changes of the index; the fields above are only changed under it
+	std::mutex writer_mutex_;
+	// Readers load the current version without locking; replaced versions are retired to the
+	// default epoch domain
+	std::atomic<const IndexVersion*> version_{ new IndexVersion() };
+	bool is_merging_ = false;
+	std::condition_variable merge_finished_;
+	ThreadPool* thread_pool_ = &ThreadPool::GetDefault();
+	// Read like version_: queries load it inside their version pin, and replaced caches are
+	// retired to the default epoch domain
+	std::atomic<QueryCache*> query_cache_{ nullptr };
+	std::shared_ptr<const snapshot::MappedFile> snapshot_file_;
+
+	explicit SearchServer(const snapshot::Reader& reader);
 
 	bool IsStopWord(std::string_view word) const;
 
 	static bool IsValidWord(std::string_view word);
 
-	std::vector<std::string> SplitIntoWordsNoStop(const std::string& text) const;
+	// Throws invalid_argument if text contains a control character
+	void SplitIntoWordsNoStop(std::string_view text, std::vector<std::string_view>& words) const;
 
 	Query ParseQuery(std::string_view text) const;
 
 	QueryWord ParseQueryWord(std::string_view text) const;
 
+	void IndexDocuments(std::vector<DocumentInput> documents);
+
+	VersionPin GetVersion() const;
+
+	// Must be called with writer_mutex_ held
+	void PublishVersion(std::unique_ptr<const IndexVersion> version);
+
+	// Returns the part index and ordinal of a live document
+	static std::optional<std::pair<size_t, uint32_t>> FindDocument(const IndexVersion& version, int document_id);
+
+	void DeleteDocuments(std::vector<int> document_ids);
+
+	// Returns the [begin, end) range of parts to merge or compact next, if any
+	static std::optional<std::pair<size_t, size_t>> PickMergeRange(const IndexVersion& version);
+
+	void ScheduleMerge();
+
+	void RunMerges();
+
 	static int ComputeAverageRating(const std::vector<int>& ratings);
 
-	double ComputeWordInverseDocumentFreq(const std::string& word) const;
+	static double ComputeWordInverseDocumentFreq(const IndexVersion& version, TermId term_id);
+
+	static std::pmr::vector<double> ComputeInverseDocumentFreqs(const IndexVersion& version, const Query& query);
+
+	static SegmentQuery ResolveQuery(const IndexSegment& segment, const Query& query);
+
+	// Returns how far the phrase's words are from phrase order at their closest, or nothing if
+	// that is more than the slop. The words may be out of order; only a distance of 0 means an
+	// exact match. word_positions are indexed like the required terms;
+	// next is scratch space that callers reuse across documents.
+	static std::optional<uint32_t> ComputePhraseDistance(const Phrase& phrase,
+		const std::pmr::vector<std::pmr::vector<uint32_t>>& word_positions, std::pmr::vector<size_t>& next);
+
+	// Returns range_count empty heaps of max_count documents for the ranges of a parallel query.
+	// Workers push into them, so they cannot draw from the calling thread's arena; instead they
+	// are kept per calling thread and reused with their capacity by its next parallel query.
+	static std::vector<TopDocuments>& GetRangeTopDocuments(size_t range_count, size_t max_count);
+
+	// Splits [first_ordinal, last_ordinal) into ranges with similar numbers of postings
+	static std::pmr::vector<uint32_t> SplitOrdinalsByPostings(uint32_t first_ordinal, uint32_t last_ordinal, const SegmentQuery& query,
+		size_t max_part_count);
+
+	// Returns the [begin, end) ordinals of the segment that the predicate may accept. A
+	// DocumentFilter with a status needs only the documents with that status.
+	template <typename DocumentPredicate>
+	static std::pair<uint32_t, uint32_t> GetCandidateOrdinals(const IndexSegment& segment, const DocumentPredicate& document_predicate) {
+		if constexpr (std::is_same_v<DocumentPredicate, DocumentFilter>) {
+			if (document_predicate.status) {
+				return segment.GetStatusRange(*document_predicate.status);
+			}
+		}
+		return { segment.GetFirstOrdinal(), segment.GetEndOrdinal() };
+	}
+
+	// Only called for ordinals from GetCandidateOrdinals
+	template <typename DocumentPredicate>
+	static bool IsAccepted(const IndexSegment& segment, uint32_t ordinal, DocumentPredicate& document_predicate) {
+		if constexpr (std::is_same_v<DocumentPredicate, DocumentFilter>) {
+			// The candidate ordinals already have the filter's status
+			const int rating = segment.GetRating(ordinal);
+			return rating >= document_predicate.min_rating && rating <= document_predicate.max_rating;
+		}
+		else {
+			return document_predicate(segment.GetDocumentId(ordinal), segment.GetStatus(ordinal), segment.GetRating(ordinal));
+		}
+	}
+
+	// Policies may order results that tie within RELEVANCE_EPSILON differently,
+	// so each of them gets its own cache entries
+	template <typename ExecutionPolicy>
+	static constexpr char GetQueryCachePolicyTag() {
+		using Policy = std::decay_t<ExecutionPolicy>;
+		if constexpr (std::is_same_v<Policy, std::execution::parallel_policy>) {
+			return 'p';
+		}
+		else if constexpr (std::is_same_v<Policy, search_policy::Wand>) {
+			return 'w';
+		}
+		else {
+			return 's';
+		}
+	}
+
+	static std::string MakeQueryCacheKey(char policy_tag, const Query& query, const DocumentFilter& filter, size_t result_count);
+
+	template <typename ExecutionPolicy, typename DocumentPredicate>
+	std::vector<Document> FindTopDocumentsForQuery(ExecutionPolicy&& policy, const IndexVersion& version, const Query& query,
+		DocumentPredicate document_predicate, size_t result_count) const;
+
+	template <typename DocumentPredicate>
+	void FindAllDocuments(const std::execution::sequenced_policy&, const IndexVersion& version, const Query& query,
+		DocumentPredicate document_predicate, TopDocuments& top_documents) const;
+
+	template <typename DocumentPredicate>
+	void FindAllDocuments(const std::execution::parallel_policy&, const IndexVersion& version, const Query& query,
+		DocumentPredicate document_predicate, TopDocuments& top_documents) const;
+
+	template <typename DocumentPredicate>
+	void FindAllDocuments(const search_policy::Wand&, const IndexVersion& version, const Query& query,
+		DocumentPredicate document_predicate, TopDocuments& top_documents) const;
 
 	template <typename DocumentPredicate>
-	std::vector<Document> FindAllDocuments(const Query& query, DocumentPredicate document_predicate) const;
+	void FindDocumentsInRange(const IndexPart& part, const SegmentQuery& query, const std::pmr::vector<double>& inverse_document_freqs,
+		DocumentPredicate& document_predicate, uint32_t first_ordinal, uint32_t last_ordinal, ScoreAccumulator& accumulator,
+		TopDocuments& top_documents) const;
 
+	// Intersects the required terms' postings, shortest first, and checks minus terms and
+	// phrase positions only for documents that have all of them
 	template <typename DocumentPredicate>
-	std::vector<Document> FindAllDocuments(const std::execution::sequenced_policy&, const Query& query, DocumentPredicate document_predicate) const;
+	void FindRequiredDocumentsInRange(const IndexPart& part, const SegmentQuery& query, const std::pmr::vector<double>& inverse_document_freqs,
+		DocumentPredicate& document_predicate, uint32_t first_ordinal, uint32_t last_ordinal, TopDocuments& top_documents) const;
 
 	template <typename DocumentPredicate>
-	std::vector<Document> FindAllDocuments(const std::execution::parallel_policy&, const Query& query, DocumentPredicate document_predicate) const;
+	void FindDocumentsWithWand(const IndexPart& part, const SegmentQuery& query, const std::pmr::vector<double>& inverse_document_freqs,
+		DocumentPredicate& document_predicate, uint32_t first_ordinal, uint32_t last_ordinal, TopDocuments& top_documents) const;
 };
 
+template <typename DocumentRange>
+void SearchServer::AddDocuments(const DocumentRange& documents) {
+	std::vector<DocumentInput> inputs;
+	for (const auto& [document_id, text, status, ratings] : documents) {
+		inputs.push_back({ document_id, text, status, &ratings });
+	}
+	IndexDocuments(std::move(inputs));
+}
+
 template<class ExecutionPolicy>
 std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(ExecutionPolicy&& policy,
 	std::string_view raw_query,
 	int document_id) const {
-	const auto& query = ParseQuery(raw_query);
-	std::vector<std::string_view> matched_words;
-	matched_words.reserve(raw_query.length());
+	const QueryArena::Scope arena_scope;
+	const auto version = GetVersion();
+	const auto query = ParseQuery(raw_query);
+	const auto location = FindDocument(*version, document_id);
+	if (!location) {
+		throw std::out_of_range("Invalid document_id");
+	}
+	const IndexSegment& segment = *version->parts[location->first].segment;
+	const uint32_t ordinal = location->second;
+	const auto has_term = [&](TermId term_id) {
+		const PostingList* postings = segment.FindPostings(term_id);
+		return postings != nullptr && postings->Contains(ordinal);
+	};
+	const DocumentStatus status = segment.GetStatus(ordinal);
 	if (std::any_of(std::execution::seq,
-		query.minus_words.begin(),
-		query.minus_words.end(),
-		[&](auto word) { return word_to_document_freqs_.at(word).count(document_id); }
+		query.minus_terms.begin(),
+		query.minus_terms.end(),
+		has_term
 	)) {
-		return { {}, documents_.at(document_id).status };
-	}
-	std::copy_if(std::execution::seq,
-		query.plus_words.begin(),
-		query.plus_words.end(),
-		std::back_inserter(matched_words),
-		[&](auto word) { return word_to_document_freqs_.at(word).count(document_id); }
-	);
-	matched_words.shrink_to_fit();
-	return { matched_words, documents_.at(document_id).status };
+		return { std::vector<std::string_view>{}, status };
+	}
+	if (!query.phrases.empty() && !version->has_positions) {
+		throw std::logic_error("Phrase queries need the positional index");
+	}
+	std::pmr::vector<std::pmr::vector<uint32_t>> word_positions(query.required_terms.size(), &QueryArena::ForCurrentThread());
+	for (size_t i = 0; i < query.required_terms.size(); ++i) {
+		const size_t term_index = segment.FindTerm(query.required_terms[i]);
+		if (term_index == IndexSegment::NO_TERM_INDEX) {
+			return { std::vector<std::string_view>{}, status };
+		}
+		auto cursor = segment.GetPostings(term_index).GetCursor();
+		cursor.SkipTo(ordinal);
+		if (cursor.IsEnd() || cursor.GetOrdinal() != ordinal) {
+			return { std::vector<std::string_view>{}, status };
+		}
+		if (!query.phrases.empty()) {
+			segment.GetPositions(term_index).Get(cursor.GetIndex(), word_positions[i]);
+		}
+	}
+	std::pmr::vector<size_t> next_positions(&QueryArena::ForCurrentThread());
+	for (const Phrase& phrase : query.phrases) {
+		if (!ComputePhraseDistance(phrase, word_positions, next_positions)) {
+			return { std::vector<std::string_view>{}, status };
+		}
+	}
+	std::vector<std::string_view> matched_words;
+	for (TermId term_id : query.plus_terms) {
+		if (has_term(term_id)) {
+			matched_words.push_back(terms_.GetWord(term_id));
+		}
+	}
+	std::sort(matched_words.begin(), matched_words.end());
+	return { matched_words, status };
 }
 
 template< class ExecutionPolicy>
 void SearchServer::RemoveDocument(ExecutionPolicy&& policy, int document_id) {
-	auto it = document_ids_.find(document_id);
-	if (it == document_ids_.end()) {
-		return;
-	}
-
-	auto& items = word_frequencies_to_document.at(document_id);
+	// Removal only marks the document in its segment, so there is no work to split
+	RemoveDocument(document_id);
+}
 
-	std::vector<const std::string_view*> words(items.size());
-	std::transform(policy, items.begin(), items.end(), words.begin(), [](auto& p) { return &p.first; });
+template <typename DocumentIdRange>
+void SearchServer::RemoveDocuments(const DocumentIdRange& document_ids) {
+	DeleteDocuments(std::vector<int>(std::begin(document_ids), std::end(document_ids)));
+}
 
-	std::for_each(policy, words.begin(), words.end(),
-		[&](auto word) {
-			word_to_document_freqs_.at(*word).erase(document_id);
-		}
-	);
+template <typename ExecutionPolicy, typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy, const std::string_view& raw_query, DocumentPredicate document_predicate,
+	size_t result_count) const {
+	const QueryArena::Scope arena_scope;
+	return FindTopDocumentsForQuery(policy, *GetVersion(), ParseQuery(raw_query), document_predicate, result_count);
+}
 
-	document_ids_.erase(document_id);
-	documents_.erase(document_id);
-	word_frequencies_to_document.erase(document_id);
+template <typename ExecutionPolicy>
+std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy, const std::string_view& raw_query, DocumentStatus status,
+	size_t result_count) const {
+	return FindTopDocuments(policy, raw_query, DocumentFilter{ status }, result_count);
 }
 
-template <typename ExecutionPolicy, typename DocumentPredicate>
-std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy, const std::string_view& raw_query, DocumentPredicate document_predicate) const {
+template <typename ExecutionPolicy>
+std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy, const std::string_view& raw_query, const DocumentFilter& filter,
+	size_t result_count) const {
+	const QueryArena::Scope arena_scope;
+	const auto version = GetVersion();
 	const auto query = ParseQuery(raw_query);
-	auto matched_documents = FindAllDocuments(policy, query, document_predicate);
-
-	sort(matched_documents.begin(), matched_documents.end(), [](const Document& lhs, const Document& rhs) {
-		if (std::abs(lhs.relevance - rhs.relevance) < 1e-6) {
-			return lhs.rating > rhs.rating;
-		}
-		else {
-			return lhs.relevance > rhs.relevance;
-		}
-		});
-	if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
-		matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
+	// The version pin also keeps the cache from being deleted
+	QueryCache* const query_cache = query_cache_.load();
+	if (!query_cache) {
+		return FindTopDocumentsForQuery(policy, *version, query, filter, result_count);
 	}
-
-	return matched_documents;
+	const std::string cache_key = MakeQueryCacheKey(GetQueryCachePolicyTag<ExecutionPolicy>(), query, filter, result_count);
+	if (auto cached = query_cache->Find(cache_key, version->generation)) {
+		return std::move(*cached);
+	}
+	auto result = FindTopDocumentsForQuery(policy, *version, query, filter, result_count);
+	query_cache->Insert(cache_key, version->generation, result);
+	return result;
 }
 
-template <typename ExecutionPolicy>
-std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy, const std::string_view& raw_query, DocumentStatus status) const {
-	return FindTopDocuments(policy, raw_query, [status](int document_id, DocumentStatus document_status, int rating) {
-		return document_status == status;
-		});
+template <typename ExecutionPolicy, typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocumentsForQuery(ExecutionPolicy&& policy, const IndexVersion& version, const Query& query,
+	DocumentPredicate document_predicate, size_t result_count) const {
+	if (!query.phrases.empty() && !version.has_positions) {
+		throw std::logic_error("Phrase queries need the positional index");
+	}
+	TopDocuments top_documents(result_count, &QueryArena::ForCurrentThread());
+	FindAllDocuments(policy, version, query, document_predicate, top_documents);
+	return top_documents.ExtractSorted();
 }
 
 template <typename DocumentPredicate>
-std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query, DocumentPredicate document_predicate) const {
-	return FindTopDocuments(std::execution::seq, raw_query, document_predicate);
+std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query, DocumentPredicate document_predicate,
+	size_t result_count) const {
+	return FindTopDocuments(std::execution::seq, raw_query, document_predicate, result_count);
 }
 
 template <typename ExecutionPolicy>
@@ -208,100 +552,388 @@ std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy, c
 }
 
 template <typename DocumentPredicate>
-std::vector<Document> SearchServer::FindAllDocuments(const std::execution::sequenced_policy&, const Query& query, DocumentPredicate document_predicate) const {
-	return FindAllDocuments(query, document_predicate);
+void SearchServer::FindAllDocuments(const std::execution::sequenced_policy&, const IndexVersion& version, const Query& query,
+	DocumentPredicate document_predicate, TopDocuments& top_documents) const {
+	const auto inverse_document_freqs = ComputeInverseDocumentFreqs(version, query);
+	ScoreAccumulator& accumulator = ScoreAccumulator::ForCurrentThread();
+	for (const IndexPart& part : version.parts) {
+		const auto [first_ordinal, last_ordinal] = GetCandidateOrdinals(*part.segment, document_predicate);
+		FindDocumentsInRange(part, ResolveQuery(*part.segment, query), inverse_document_freqs, document_predicate,
+			first_ordinal, last_ordinal, accumulator, top_documents);
+	}
 }
 
+template <typename DocumentPredicate>
+void SearchServer::FindAllDocuments(const std::execution::parallel_policy&, const IndexVersion& version, const Query& query,
+	DocumentPredicate document_predicate, TopDocuments& top_documents) const {
+	struct SearchRange {
+		size_t part_index;
+		uint32_t first_ordinal;
+		uint32_t last_ordinal;
+	};
+
+	ThreadPool& thread_pool = *thread_pool_;
+	// Splitting into ranges and merging their heaps only costs time without other threads
+	if (thread_pool.GetParallelism() == 1) {
+		FindAllDocuments(std::execution::seq, version, query, document_predicate, top_documents);
+		return;
+	}
+	QueryArena& arena = QueryArena::ForCurrentThread();
+	const auto inverse_document_freqs = ComputeInverseDocumentFreqs(version, query);
+	std::pmr::vector<SegmentQuery> segment_queries(&arena);
+	segment_queries.reserve(version.parts.size());
+	std::pmr::vector<SearchRange> ranges(&arena);
+	for (size_t i = 0; i < version.parts.size(); ++i) {
+		segment_queries.push_back(ResolveQuery(*version.parts[i].segment, query));
+		const auto [first_ordinal, last_ordinal] = GetCandidateOrdinals(*version.parts[i].segment, document_predicate);
+		const auto part_bounds = SplitOrdinalsByPostings(first_ordinal, last_ordinal, segment_queries.back(),
+			thread_pool.GetParallelism() * 4);
+		for (size_t j = 0; j + 1 < part_bounds.size(); ++j) {
+			ranges.push_back({ i, part_bounds[j], part_bounds[j + 1] });
+		}
+	}
+
+	std::vector<TopDocuments>& range_top_documents = GetRangeTopDocuments(ranges.size(), top_documents.GetMaxCount());
+	thread_pool.ParallelFor(ranges.size(), [&](size_t i) {
+		// The required-term evaluator takes scratch from the worker's own arena
+		const QueryArena::Scope arena_scope;
+		const SearchRange& range = ranges[i];
+		FindDocumentsInRange(version.parts[range.part_index], segment_queries[range.part_index], inverse_document_freqs, document_predicate,
+			range.first_ordinal, range.last_ordinal, ScoreAccumulator::ForCurrentThread(), range_top_documents[i]);
+		});
+
+	for (auto& range : range_top_documents) {
+		range.ExtractSorted([&top_documents](Document document) {
+			top_documents.Push(document);
+			});
+	}
+}
 
 template <typename DocumentPredicate>
-std::vector<Document> SearchServer::FindAllDocuments(const Query& query, DocumentPredicate document_predicate) const {
-	std::map<int, double> document_to_relevance;
-	for (std::string_view word : query.plus_words) {
-		if (word_to_document_freqs_.count(word) == 0) {
+void SearchServer::FindDocumentsInRange(const IndexPart& part, const SegmentQuery& query, const std::pmr::vector<double>& inverse_document_freqs,
+	DocumentPredicate& document_predicate, uint32_t first_ordinal, uint32_t last_ordinal, ScoreAccumulator& accumulator,
+	TopDocuments& top_documents) const {
+	if (!query.required_postings.empty()) {
+		FindRequiredDocumentsInRange(part, query, inverse_document_freqs, document_predicate, first_ordinal, last_ordinal, top_documents);
+		return;
+	}
+	if (first_ordinal == last_ordinal) {
+		return;
+	}
+	accumulator.Reset(first_ordinal, last_ordinal);
+	const IndexSegment& segment = *part.segment;
+
+	for (const PostingList* postings : query.minus_postings) {
+		if (postings == nullptr) {
 			continue;
 		}
-		const double inverse_document_freq = ComputeWordInverseDocumentFreq(std::string(word));
-		for (const auto [document_id, term_freq] : word_to_document_freqs_.at(word)) {
-			const auto& document_data = documents_.at(document_id);
-			if (document_predicate(document_id, document_data.status, document_data.rating)) {
-				document_to_relevance[document_id] += term_freq * inverse_document_freq;
-			}
+		auto cursor = postings->GetCursor();
+		for (cursor.SkipTo(first_ordinal); !cursor.IsEnd() && cursor.GetOrdinal() < last_ordinal; cursor.Next()) {
+			accumulator.Exclude(cursor.GetOrdinal());
 		}
 	}
 
-	for (std::string_view word : query.minus_words) {
-		if (word_to_document_freqs_.count(word) == 0) {
+	// Postings are scored a block at a time, then filtered and accumulated
+	PostingList::DecodedBlock block;
+	double scores[PostingList::BLOCK_SIZE];
+	const double* inv_word_counts = segment.GetInvWordCounts().data();
+	for (size_t i = 0; i < query.plus_postings.size(); ++i) {
+		if (query.plus_postings[i] == nullptr) {
 			continue;
 		}
-		for (const auto [document_id, _] : word_to_document_freqs_.at(word)) {
-			document_to_relevance.erase(document_id);
+		auto cursor = query.plus_postings[i]->GetCursor();
+		cursor.SkipTo(first_ordinal);
+		while (!cursor.IsEnd() && cursor.GetOrdinal() < last_ordinal) {
+			cursor.ReadBlock(last_ordinal, block);
+			ComputeTermScores(block.ordinals, block.counts, block.size, inv_word_counts, segment.GetFirstOrdinal(),
+				inverse_document_freqs[i], scores);
+			for (size_t j = 0; j < block.size; ++j) {
+				const uint32_t ordinal = block.ordinals[j];
+				if (accumulator.IsExcluded(ordinal) || part.IsDeleted(ordinal)) {
+					continue;
+				}
+				if (IsAccepted(segment, ordinal, document_predicate)) {
+					accumulator.Add(ordinal, scores[j]);
+				}
+			}
 		}
 	}
 
-	std::vector<Document> matched_documents;
-	for (const auto [document_id, relevance] : document_to_relevance) {
-		matched_documents.push_back({ document_id, relevance, documents_.at(document_id).rating });
+	accumulator.ForEachScore([&](uint32_t ordinal, double relevance) {
+		top_documents.Push({ segment.GetDocumentId(ordinal), relevance, segment.GetRating(ordinal) });
+		});
+}
+
+template <typename DocumentPredicate>
+void SearchServer::FindAllDocuments(const search_policy::Wand&, const IndexVersion& version, const Query& query,
+	DocumentPredicate document_predicate, TopDocuments& top_documents) const {
+	if (query.plus_terms.size() > MAX_WAND_TERM_COUNT) {
+		FindAllDocuments(std::execution::seq, version, query, document_predicate, top_documents);
+		return;
+	}
+	// Segments share top_documents, so results found in one raise the threshold for the next
+	const auto inverse_document_freqs = ComputeInverseDocumentFreqs(version, query);
+	for (const IndexPart& part : version.parts) {
+		const SegmentQuery segment_query = ResolveQuery(*part.segment, query);
+		const auto [first_ordinal, last_ordinal] = GetCandidateOrdinals(*part.segment, document_predicate);
+		if (query.required_terms.empty()) {
+			FindDocumentsWithWand(part, segment_query, inverse_document_freqs, document_predicate, first_ordinal, last_ordinal, top_documents);
+		}
+		else {
+			FindRequiredDocumentsInRange(part, segment_query, inverse_document_freqs, document_predicate, first_ordinal, last_ordinal, top_documents);
+		}
 	}
-	return matched_documents;
 }
 
 template <typename DocumentPredicate>
-std::vector<Document> SearchServer::FindAllDocuments(const std::execution::parallel_policy&, const Query& query, DocumentPredicate document_predicate) const {
-	ConcurrentMap<int, double> document_to_relevance(10000);
-	{
-		static constexpr int PART_COUNT = 16;
-		const auto part_length = query.plus_words.size() / PART_COUNT;
-		auto part_begin = query.plus_words.begin();
-		auto part_end = std::next(part_begin, part_length);
-
-		auto function = [&](std::string_view word) {
-			if (word_to_document_freqs_.count(word) != 0) {
-				const double inverse_document_freq = ComputeWordInverseDocumentFreq(std::string(word));
-				for (const auto& [document_id, term_freq] : word_to_document_freqs_.at(word)) {
-					const auto& document_data = documents_.at(document_id);
-					if (document_predicate(document_id, document_data.status, document_data.rating)) {
-						document_to_relevance[document_id].ref_to_value += term_freq * inverse_document_freq;
-					}
-				}
-			}
-		};
+void SearchServer::FindRequiredDocumentsInRange(const IndexPart& part, const SegmentQuery& query, const std::pmr::vector<double>& inverse_document_freqs,
+	DocumentPredicate& document_predicate, uint32_t first_ordinal, uint32_t last_ordinal, TopDocuments& top_documents) const {
+	struct TermCursor {
+		PostingList::Cursor cursor;
+		size_t term_index;
+	};
 
-		std::vector<std::future<void>> futures;
-		for (int i = 0;	i < PART_COUNT;	++i,
-			part_begin = part_end, part_end = (i == PART_COUNT - 1 ? query.plus_words.end() : next(part_begin, part_length))) {
-			futures.push_back(std::async([=] {
-				std::for_each(std::execution::par, part_begin, part_end, function);
-				}));
+	if (first_ordinal == last_ordinal
+		|| std::find(query.required_postings.begin(), query.required_postings.end(), nullptr) != query.required_postings.end()) {
+		return;
+	}
+	const IndexSegment& segment = *part.segment;
+	QueryArena& arena = QueryArena::ForCurrentThread();
+
+	// Candidates come from the shortest list, the other lists are skipped forward to them
+	std::pmr::vector<PostingList::Cursor> required_cursors(&arena);
+	std::pmr::vector<size_t> required_order(&arena);
+	for (size_t i = 0; i < query.required_postings.size(); ++i) {
+		required_cursors.push_back(query.required_postings[i]->GetCursor());
+		required_order.push_back(i);
+	}
+	std::sort(required_order.begin(), required_order.end(), [&query](size_t lhs, size_t rhs) {
+		return query.required_postings[lhs]->size() < query.required_postings[rhs]->size();
+		});
+	std::pmr::vector<TermCursor> plus_cursors(&arena);
+	for (size_t i = 0; i < query.plus_postings.size(); ++i) {
+		if (query.plus_postings[i] != nullptr) {
+			plus_cursors.push_back({ query.plus_postings[i]->GetCursor(), i });
+		}
+	}
+	std::pmr::vector<PostingList::Cursor> minus_cursors(&arena);
+	for (const PostingList* postings : query.minus_postings) {
+		if (postings != nullptr) {
+			minus_cursors.push_back(postings->GetCursor());
+		}
+	}
+	const auto is_excluded = [&minus_cursors](uint32_t ordinal) {
+		return std::any_of(minus_cursors.begin(), minus_cursors.end(), [ordinal](PostingList::Cursor& cursor) {
+			cursor.SkipTo(ordinal);
+			return !cursor.IsEnd() && cursor.GetOrdinal() == ordinal;
+			});
+	};
+	std::pmr::vector<std::pmr::vector<uint32_t>> word_positions(query.required_postings.size(), &arena);
+	std::pmr::vector<size_t> next_positions(&arena);
+	std::pmr::vector<bool> is_phrase_word(query.required_postings.size(), false, &arena);
+	for (const Phrase& phrase : query.phrases) {
+		for (uint32_t word : phrase.words) {
+			is_phrase_word[word] = true;
 		}
 	}
 
-	{
-		static constexpr int PART_COUNT = 8;
-		const auto part_length = query.minus_words.size() / PART_COUNT;
-		auto part_begin = query.minus_words.begin();
-		auto part_end = std::next(part_begin, part_length);
-
-		auto function = [&](std::string_view word) {
-			if (word_to_document_freqs_.count(word) > 0) {
-				for (const auto& [document_id, _] : word_to_document_freqs_.at(word)) {
-					document_to_relevance.erase(document_id);
-				}
+	for (uint32_t candidate = first_ordinal;;) {
+		bool is_common = true;
+		for (size_t i : required_order) {
+			PostingList::Cursor& cursor = required_cursors[i];
+			cursor.SkipTo(candidate);
+			if (cursor.IsEnd() || cursor.GetOrdinal() >= last_ordinal) {
+				return;
 			}
-		};
+			if (cursor.GetOrdinal() != candidate) {
+				candidate = cursor.GetOrdinal();
+				is_common = false;
+				break;
+			}
+		}
+		if (!is_common) {
+			continue;
+		}
+		const uint32_t ordinal = candidate++;
+		if (part.IsDeleted(ordinal) || is_excluded(ordinal) || !IsAccepted(segment, ordinal, document_predicate)) {
+			continue;
+		}
 
-		std::vector<std::future<void>> futures;
-		for (int i = 0;	i < PART_COUNT;	++i,
-			part_begin = part_end, part_end = (i == PART_COUNT - 1 ? query.minus_words.end() : next(part_begin, part_length))) {
-			futures.push_back(std::async([=] {
-				std::for_each(part_begin, part_end, function);
-				}));
+		for (size_t i = 0; i < required_cursors.size(); ++i) {
+			if (is_phrase_word[i]) {
+				query.required_positions[i]->Get(required_cursors[i].GetIndex(), word_positions[i]);
+			}
+		}
+		double phrase_score = 0.0;
+		bool is_match = true;
+		for (const Phrase& phrase : query.phrases) {
+			const auto distance = ComputePhraseDistance(phrase, word_positions, next_positions);
+			if (!distance) {
+				is_match = false;
+				break;
+			}
+			double phrase_weight = 0.0;
+			for (uint32_t word : phrase.words) {
+				phrase_weight += inverse_document_freqs[query.required_plus_indexes[word]];
+			}
+			phrase_score += phrase_weight / (1 + *distance);
 		}
+		if (!is_match) {
+			continue;
+		}
+
+		// Plus terms are added in query term order like in the other evaluators, then the boost
+		const double inv_word_count = segment.GetInvWordCounts()[ordinal - segment.GetFirstOrdinal()];
+		double relevance = 0.0;
+		for (TermCursor& term : plus_cursors) {
+			term.cursor.SkipTo(ordinal);
+			if (!term.cursor.IsEnd() && term.cursor.GetOrdinal() == ordinal) {
+				relevance += term.cursor.GetCount() * inv_word_count * inverse_document_freqs[term.term_index];
+			}
+		}
+		top_documents.Push({ segment.GetDocumentId(ordinal), relevance + phrase_score * inv_word_count, segment.GetRating(ordinal) });
 	}
+}
 
-	std::vector<Document> matched_documents;
-	for (const auto& [document_id, relevance] : document_to_relevance.BuildOrdinaryMap()) {
-		matched_documents.push_back({ document_id, relevance, documents_.at(document_id).rating });
+template <typename DocumentPredicate>
+void SearchServer::FindDocumentsWithWand(const IndexPart& part, const SegmentQuery& query, const std::pmr::vector<double>& inverse_document_freqs,
+	DocumentPredicate& document_predicate, uint32_t first_ordinal, uint32_t last_ordinal, TopDocuments& top_documents) const {
+	struct TermCursor {
+		PostingList::Cursor cursor;
+		size_t term_index;
+		double inverse_document_freq;
+		double max_score;
+	};
+
+	// With no room for results every document would be pruned against an empty heap
+	if (top_documents.GetMaxCount() == 0) {
+		return;
 	}
+	const IndexSegment& segment = *part.segment;
+	QueryArena& arena = QueryArena::ForCurrentThread();
+	std::pmr::vector<TermCursor> terms(&arena);
+	for (size_t i = 0; i < query.plus_postings.size(); ++i) {
+		const PostingList* postings = query.plus_postings[i];
+		if (postings != nullptr && !postings->empty()) {
+			const double inverse_document_freq = inverse_document_freqs[i];
+			terms.push_back({ postings->GetCursor(), i, inverse_document_freq, postings->GetMaxTermFreq() * inverse_document_freq });
+			terms.back().cursor.SkipTo(first_ordinal);
+		}
+	}
+	std::pmr::vector<PostingList::Cursor> minus_cursors(&arena);
+	for (const PostingList* postings : query.minus_postings) {
+		if (postings != nullptr) {
+			minus_cursors.push_back(postings->GetCursor());
+		}
+	}
+	const auto is_excluded = [&minus_cursors](uint32_t ordinal) {
+		return std::any_of(minus_cursors.begin(), minus_cursors.end(), [ordinal](PostingList::Cursor& cursor) {
+			cursor.SkipTo(ordinal);
+			return !cursor.IsEnd() && cursor.GetOrdinal() == ordinal;
+			});
+	};
+	// (term index, score) of the terms of the document being scored
+	std::pmr::vector<std::pair<size_t, double>> term_scores(&arena);
 
-	return matched_documents;
-}
+	// Live cursors sorted by ordinal. A step only moves a prefix of them forward, so each
+	// moved cursor is shifted right into place and exhausted ones are dropped.
+	const auto is_exhausted = [last_ordinal](const TermCursor* term) {
+		return term->cursor.IsEnd() || term->cursor.GetOrdinal() >= last_ordinal;
+	};
+	std::pmr::vector<TermCursor*> cursors(&arena);
+	for (TermCursor& term : terms) {
+		if (!is_exhausted(&term)) {
+			cursors.push_back(&term);
+		}
+	}
+	std::sort(cursors.begin(), cursors.end(), [](const TermCursor* lhs, const TermCursor* rhs) {
+		return lhs->cursor.GetOrdinal() < rhs->cursor.GetOrdinal();
+		});
+	const auto restore_order = [&cursors, &is_exhausted](size_t moved_count) {
+		for (size_t i = moved_count; i-- > 0;) {
+			TermCursor* moved = cursors[i];
+			if (is_exhausted(moved)) {
+				cursors.erase(cursors.begin() + i);
+				continue;
+			}
+			const uint32_t ordinal = moved->cursor.GetOrdinal();
+			size_t position = i;
+			for (; position + 1 < cursors.size() && cursors[position + 1]->cursor.GetOrdinal() < ordinal; ++position) {
+				cursors[position] = cursors[position + 1];
+			}
+			cursors[position] = moved;
+		}
+	};
+
+	while (!cursors.empty()) {
+		// A document has to beat the current worst result by more than the comparator tolerance;
+		// the extra epsilon absorbs rounding differences between the bounds and the exact scores
+		const double threshold = top_documents.IsFull()
+			? top_documents.GetWorst().relevance - 2 * RELEVANCE_EPSILON
+			: -std::numeric_limits<double>::infinity();
+
+		size_t pivot = 0;
+		for (double bound = 0.0; pivot < cursors.size(); ++pivot) {
+			bound += cursors[pivot]->max_score;
+			if (bound >= threshold) {
+				break;
+			}
+		}
+		if (pivot == cursors.size()) {
+			break;
+		}
+		const uint32_t pivot_ordinal = cursors[pivot]->cursor.GetOrdinal();
+		while (pivot + 1 < cursors.size() && cursors[pivot + 1]->cursor.GetOrdinal() == pivot_ordinal) {
+			++pivot;
+		}
+
+		uint32_t next_ordinal = pivot + 1 < cursors.size()
+			? cursors[pivot + 1]->cursor.GetOrdinal()
+			: std::numeric_limits<uint32_t>::max();
+		double block_bound = 0.0;
+		for (size_t i = 0; i <= pivot; ++i) {
+			const PostingList::SkipEntry* block = cursors[i]->cursor.PeekBlock(pivot_ordinal);
+			if (block != nullptr) {
+				block_bound += block->max_term_freq * cursors[i]->inverse_document_freq;
+				next_ordinal = std::min(next_ordinal, block->last_ordinal + 1);
+			}
+		}
+		if (block_bound < threshold) {
+			for (size_t i = 0; i <= pivot; ++i) {
+				cursors[i]->cursor.SkipTo(next_ordinal);
+			}
+			restore_order(pivot + 1);
+			continue;
+		}
+
+		if (cursors[0]->cursor.GetOrdinal() != pivot_ordinal) {
+			size_t lagging_count = 0;
+			for (; lagging_count < pivot && cursors[lagging_count]->cursor.GetOrdinal() < pivot_ordinal; ++lagging_count) {
+				cursors[lagging_count]->cursor.SkipTo(pivot_ordinal);
+			}
+			restore_order(lagging_count);
+			continue;
+		}
+
+		if (!part.IsDeleted(pivot_ordinal) && IsAccepted(segment, pivot_ordinal, document_predicate) && !is_excluded(pivot_ordinal)) {
+			// Sum in query term order to reproduce the exhaustive evaluators bit for bit;
+			// terms missing from the document would only add zeros
+			term_scores.clear();
+			const double inv_word_count = segment.GetInvWordCounts()[pivot_ordinal - segment.GetFirstOrdinal()];
+			for (size_t i = 0; i <= pivot; ++i) {
+				const double term_freq = cursors[i]->cursor.GetCount() * inv_word_count;
+				term_scores.emplace_back(cursors[i]->term_index, term_freq * cursors[i]->inverse_document_freq);
+			}
+			std::sort(term_scores.begin(), term_scores.end());
+			double relevance = 0.0;
+			for (const auto& [term_index, score] : term_scores) {
+				relevance += score;
+			}
+			top_documents.Push({ segment.GetDocumentId(pivot_ordinal), relevance, segment.GetRating(pivot_ordinal) });
+		}
+		for (size_t i = 0; i <= pivot; ++i) {
+			cursors[i]->cursor.Next();
+		}
+		restore_order(pivot + 1);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,33 @@
+#include "stop_word_set.h"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+StopWordSet::StopWordSet(const std::set<std::string, std::less<>>& words)
+    : words_(words.begin(), words.end())
+{
+    if (words_.size() > std::numeric_limits<uint32_t>::max() / 2) {
+        throw std::length_error("Too many stop words");
+    }
+    size_t slot_count = 1;
+    while (slot_count < words_.size() * 2) {
+        slot_count *= 2;
+    }
+    slots_.assign(slot_count, Slot{});
+    slot_mask_ = slot_count - 1;
+
+    for (uint32_t word_index = 0; word_index < words_.size(); ++word_index) {
+        const std::string_view word = words_[word_index];
+        if (word.empty() || word.size() > std::numeric_limits<uint32_t>::max()) {
+            throw std::invalid_argument("Stop word length is out of range");
+        }
+        max_length_ = std::max(max_length_, word.size());
+        const uint64_t prefix = LoadPrefix(word);
+        size_t i = GetSlotIndex(prefix, word.size());
+        while (slots_[i].length != 0) {
+            i = (i + 1) & slot_mask_;
+        }
+        slots_[i] = { prefix, static_cast<uint32_t>(word.size()), word_index };
+    }
+}
\ No newline at end of file
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Immutable set of words backed by an open-addressing table at most half full.
+// Each slot keeps the word's length and first eight bytes, so a lookup usually
+// settles on the first probe without touching the stored words.
+class StopWordSet {
+public:
+    StopWordSet() = default;
+
+    explicit StopWordSet(const std::set<std::string, std::less<>>& words);
+
+    bool Contains(std::string_view word) const {
+        if (word.empty() || word.size() > max_length_) {
+            return false;
+        }
+        const uint64_t prefix = LoadPrefix(word);
+        for (size_t i = GetSlotIndex(prefix, word.size()); slots_[i].length != 0; i = (i + 1) & slot_mask_) {
+            const Slot& slot = slots_[i];
+            if (slot.prefix == prefix && slot.length == word.size()
+                && (word.size() <= PREFIX_SIZE || std::string_view(words_[slot.word_index]).substr(PREFIX_SIZE) == word.substr(PREFIX_SIZE))) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    std::vector<std::string>::const_iterator begin() const {
+        return words_.begin();
+    }
+
+    std::vector<std::string>::const_iterator end() const {
+        return words_.end();
+    }
+
+    size_t size() const {
+        return words_.size();
+    }
+
+private:
+    static constexpr size_t PREFIX_SIZE = sizeof(uint64_t);
+
+    struct Slot {
+        uint64_t prefix = 0;
+        uint32_t length = 0;
+        uint32_t word_index = 0;
+    };
+
+    std::vector<std::string> words_;
+    std::vector<Slot> slots_ = std::vector<Slot>(1);
+    size_t slot_mask_ = 0;
+    size_t max_length_ = 0;
+
+    static uint64_t LoadPrefix(std::string_view word) {
+        uint64_t prefix = 0;
+        std::memcpy(&prefix, word.data(), std::min(word.size(), PREFIX_SIZE));
+        return prefix;
+    }
+
+    size_t GetSlotIndex(uint64_t prefix, size_t length) const {
+        uint64_t hash = (prefix ^ (length * 0x9E3779B97F4A7C15ull)) * 0xBF58476D1CE4E5B9ull;
+        hash ^= hash >> 31;
+        return static_cast<size_t>(hash) & slot_mask_;
+    }
+};
\ No newline at end of file
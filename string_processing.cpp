@@ -1,35 +1,138 @@
 #include "string_processing.h"
 
-std::vector<std::string> SplitIntoWords(const std::string& text) {
-    std::vector<std::string> words;
-    words.reserve(text.length() / 5);
-    std::string word;
-    for (const char c : text) {
-        if (c == ' ') {
-            if (!word.empty()) {
-                words.push_back(std::move(word));
-            }
+#include <cstdint>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define STRING_PROCESSING_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define STRING_PROCESSING_AVX2
+#include <immintrin.h>
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace {
+
+int CountTrailingZeros(uint32_t mask) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return static_cast<int>(index);
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+// Appends the words that end at the spaces marked in space_mask, bit i standing for text[offset + i]
+inline void AppendWordsEndingAt(std::string_view text, size_t offset, uint32_t space_mask,
+    size_t& word_begin, std::vector<std::string_view>& words) {
+    while (space_mask != 0) {
+        const size_t space = offset + CountTrailingZeros(space_mask);
+        if (space > word_begin) {
+            words.push_back(text.substr(word_begin, space - word_begin));
         }
-        else {
-            word += c;
+        word_begin = space + 1;
+        space_mask &= space_mask - 1;
+    }
+}
+
+// Splits text[first, end) byte by byte and appends the last word. Returns false on a control character.
+bool SplitTail(std::string_view text, size_t first, size_t word_begin, std::vector<std::string_view>& words) {
+    bool is_valid = true;
+    for (size_t i = first; i < text.size(); ++i) {
+        const unsigned char c = static_cast<unsigned char>(text[i]);
+        if (c > ' ') {
+            continue;
+        }
+        if (c < ' ') {
+            is_valid = false;
+            continue;
+        }
+        if (i > word_begin) {
+            words.push_back(text.substr(word_begin, i - word_begin));
         }
+        word_begin = i + 1;
     }
-    if (!word.empty()) {
-        words.push_back(std::move(word));
+    if (word_begin < text.size()) {
+        words.push_back(text.substr(word_begin));
     }
+    return is_valid;
+}
 
-    return words;
+#ifndef STRING_PROCESSING_SSE2
+bool SplitIntoWordsScalar(std::string_view text, std::vector<std::string_view>& words) {
+    return SplitTail(text, 0, 0, words);
 }
+#endif
 
-std::set<std::string_view> SplitIntoWordsView(std::string_view str) {
-    std::set<std::string_view> result;
-    while (true) {
-        size_t space = str.find(' ');
-        result.insert(str.substr(0, space));
-        if (space == str.npos) {
-            break;
-        }
-        str.remove_prefix(space + 1);
+// The vector kernels classify a whole block at once: a byte is a space if it equals ' '
+// and a control character if it is below ' ' as an unsigned value, that is max(c, ' ') == ' '
+
+#ifdef STRING_PROCESSING_SSE2
+bool SplitIntoWordsSse2(std::string_view text, std::vector<std::string_view>& words) {
+    const __m128i spaces = _mm_set1_epi8(' ');
+    uint32_t control_mask = 0;
+    size_t word_begin = 0;
+    size_t i = 0;
+    for (; i + 16 <= text.size(); i += 16) {
+        const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text.data() + i));
+        const __m128i is_space = _mm_cmpeq_epi8(block, spaces);
+        const __m128i is_blank = _mm_cmpeq_epi8(_mm_max_epu8(block, spaces), spaces);
+        control_mask |= static_cast<uint32_t>(_mm_movemask_epi8(_mm_andnot_si128(is_space, is_blank)));
+        AppendWordsEndingAt(text, i, static_cast<uint32_t>(_mm_movemask_epi8(is_space)), word_begin, words);
+    }
+    return SplitTail(text, i, word_begin, words) && control_mask == 0;
+}
+#endif
+
+#ifdef STRING_PROCESSING_AVX2
+__attribute__((target("avx2")))
+bool SplitIntoWordsAvx2(std::string_view text, std::vector<std::string_view>& words) {
+    const __m256i spaces = _mm256_set1_epi8(' ');
+    uint32_t control_mask = 0;
+    size_t word_begin = 0;
+    size_t i = 0;
+    for (; i + 32 <= text.size(); i += 32) {
+        const __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text.data() + i));
+        const __m256i is_space = _mm256_cmpeq_epi8(block, spaces);
+        const __m256i is_blank = _mm256_cmpeq_epi8(_mm256_max_epu8(block, spaces), spaces);
+        control_mask |= static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_andnot_si256(is_space, is_blank)));
+        AppendWordsEndingAt(text, i, static_cast<uint32_t>(_mm256_movemask_epi8(is_space)), word_begin, words);
+    }
+    return SplitTail(text, i, word_begin, words) && control_mask == 0;
+}
+#endif
+
+using SplitFunction = bool (*)(std::string_view, std::vector<std::string_view>&);
+
+SplitFunction SelectSplitFunction() {
+#ifdef STRING_PROCESSING_AVX2
+    if (__builtin_cpu_supports("avx2")) {
+        return SplitIntoWordsAvx2;
     }
-    return result;
+#endif
+#ifdef STRING_PROCESSING_SSE2
+    return SplitIntoWordsSse2;
+#else
+    return SplitIntoWordsScalar;
+#endif
+}
+
+}
+
+bool SplitIntoWords(std::string_view text, std::vector<std::string_view>& words) {
+    static const SplitFunction split_function = SelectSplitFunction();
+    words.clear();
+    return split_function(text, words);
+}
+
+std::vector<std::string_view> SplitIntoWords(std::string_view text) {
+    std::vector<std::string_view> words;
+    SplitIntoWords(text, words);
+    return words;
 }
\ No newline at end of file
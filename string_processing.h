@@ -3,14 +3,17 @@
 #include <vector>
 #include <string>
 #include <set>
+#include <string_view>
 
-std::vector<std::string> SplitIntoWords(const std::string& text);
+// Replaces the contents of words with the space-separated words of text, skipping empty ones.
+// The views point into text. Returns false if text contains a control character.
+bool SplitIntoWords(std::string_view text, std::vector<std::string_view>& words);
 
-std::set<std::string_view> SplitIntoWordsView(std::string_view str);
+std::vector<std::string_view> SplitIntoWords(std::string_view text);
 
 template <typename StringContainer>
-std::set<std::string> MakeUniqueNonEmptyStrings(const StringContainer& strings) {
-    std::set<std::string> non_empty_strings;
+std::set<std::string, std::less<>> MakeUniqueNonEmptyStrings(const StringContainer& strings) {
+    std::set<std::string, std::less<>> non_empty_strings;
     for (const auto& str : strings) {
         std::string temp{ str };
         if (!temp.empty()) {
@@ -0,0 +1,155 @@
+#include "term_dictionary.h"
+
+#include "epoch_domain.h"
+
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+
+namespace {
+
+constexpr size_t INITIAL_INDEX_CAPACITY = 1024;
+
+size_t FloorLog2(size_t value) {
+#if defined(__GNUC__) || defined(__clang__)
+    return 63 - __builtin_clzll(value);
+#else
+    size_t result = 0;
+    while (value >>= 1) {
+        ++result;
+    }
+    return result;
+#endif
+}
+
+}
+
+TermDictionary::HashIndex::HashIndex(size_t capacity)
+    : slots(new std::atomic<uint64_t>[capacity])
+    , mask(capacity - 1)
+{
+    for (size_t i = 0; i < capacity; ++i) {
+        slots[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+TermDictionary::TermDictionary()
+    : index_(new HashIndex(INITIAL_INDEX_CAPACITY))
+{
+}
+
+TermDictionary::~TermDictionary() {
+    for (auto& chunk : word_chunks_) {
+        delete[] chunk.load();
+    }
+    delete index_.load();
+}
+
+TermId TermDictionary::Intern(std::string_view word) {
+    return AddWord(word, false);
+}
+
+TermId TermDictionary::InternExternal(std::string_view word) {
+    return AddWord(word, true);
+}
+
+TermId TermDictionary::Find(std::string_view word) const {
+    const uint64_t hash = Hash(word);
+    const EpochDomain::Guard guard;
+    const HashIndex& index = *index_.load();
+    for (size_t i = hash & index.mask;; i = (i + 1) & index.mask) {
+        const uint64_t slot = index.slots[i].load(std::memory_order_acquire);
+        if (slot == 0) {
+            return NO_TERM;
+        }
+        const TermId term_id = static_cast<TermId>(slot) - 1;
+        if (slot >> 32 == hash >> 32 && GetWordSlot(term_id) == word) {
+            return term_id;
+        }
+    }
+}
+
+std::string_view TermDictionary::GetWord(TermId term_id) const {
+    if (term_id >= GetTermCount()) {
+        throw std::out_of_range("Unknown term id");
+    }
+    return GetWordSlot(term_id);
+}
+
+size_t TermDictionary::GetTermCount() const {
+    return term_count_.load(std::memory_order_acquire);
+}
+
+TermId TermDictionary::AddWord(std::string_view word, bool is_external) {
+    const TermId existing_id = Find(word);
+    if (existing_id != NO_TERM) {
+        return existing_id;
+    }
+    const size_t term_count = term_count_.load(std::memory_order_relaxed);
+    if (term_count == NO_TERM) {
+        throw std::length_error("Term dictionary is full");
+    }
+    const TermId term_id = static_cast<TermId>(term_count);
+
+    // Readers reach the word only after it is stored and counted
+    const size_t chunk = FloorLog2(term_id / FIRST_CHUNK_SIZE + 1);
+    if (word_chunks_[chunk].load(std::memory_order_relaxed) == nullptr) {
+        word_chunks_[chunk].store(new std::string_view[FIRST_CHUNK_SIZE << chunk], std::memory_order_release);
+    }
+    GetWordSlot(term_id) = is_external ? word : StoreWord(word);
+    term_count_.store(term_count + 1, std::memory_order_release);
+
+    HashIndex* index = index_.load(std::memory_order_relaxed);
+    if ((term_count + 1) * 2 > index->mask + 1) {
+        auto grown = std::make_unique<HashIndex>((index->mask + 1) * 2);
+        for (TermId i = 0; i < term_id; ++i) {
+            Insert(*grown, Hash(GetWordSlot(i)), i);
+        }
+        index_.store(grown.release(), std::memory_order_release);
+        EpochDomain::GetDefault().Retire(index);
+        index = index_.load(std::memory_order_relaxed);
+    }
+    Insert(*index, Hash(word), term_id);
+    return term_id;
+}
+
+std::string_view& TermDictionary::GetWordSlot(TermId term_id) const {
+    const size_t chunk = FloorLog2(term_id / FIRST_CHUNK_SIZE + 1);
+    const size_t chunk_begin = FIRST_CHUNK_SIZE * ((size_t{ 1 } << chunk) - 1);
+    return word_chunks_[chunk].load(std::memory_order_acquire)[term_id - chunk_begin];
+}
+
+void TermDictionary::Insert(HashIndex& index, uint64_t hash, TermId term_id) {
+    size_t i = hash & index.mask;
+    while (index.slots[i].load(std::memory_order_relaxed) != 0) {
+        i = (i + 1) & index.mask;
+    }
+    index.slots[i].store((hash >> 32 << 32) | (uint64_t{ term_id } + 1), std::memory_order_release);
+}
+
+uint64_t TermDictionary::Hash(std::string_view word) {
+    return std::hash<std::string_view>()(word);
+}
+
+std::string_view TermDictionary::StoreWord(std::string_view word) {
+    if (word.empty()) {
+        return {};
+    }
+    char* data = nullptr;
+    if (word.size() > ARENA_BLOCK_SIZE / 4) {
+        // Long words get a dedicated block so that the current one keeps filling up
+        arena_blocks_.push_back(std::make_unique<char[]>(word.size()));
+        data = arena_blocks_.back().get();
+    }
+    else {
+        if (ARENA_BLOCK_SIZE - current_block_used_ < word.size()) {
+            arena_blocks_.push_back(std::make_unique<char[]>(ARENA_BLOCK_SIZE));
+            current_block_ = arena_blocks_.back().get();
+            current_block_used_ = 0;
+        }
+        data = current_block_ + current_block_used_;
+        current_block_used_ += word.size();
+    }
+    std::memcpy(data, word.data(), word.size());
+    return { data, word.size() };
+}
\ No newline at end of file
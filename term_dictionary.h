@@ -0,0 +1,72 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+using TermId = uint32_t;
+
+// Interns words into an append-only character arena and hands out dense term ids.
+// Views returned by the dictionary stay valid for its whole lifetime. Find and GetWord
+// take no locks and may run while another thread interns words; interning itself has
+// to be done by one thread at a time.
+class TermDictionary {
+public:
+    static constexpr TermId NO_TERM = std::numeric_limits<TermId>::max();
+
+    TermDictionary();
+
+    TermDictionary(const TermDictionary&) = delete;
+    TermDictionary& operator=(const TermDictionary&) = delete;
+
+    ~TermDictionary();
+
+    TermId Intern(std::string_view word);
+
+    // Like Intern, but keeps the view instead of copying the word into the arena,
+    // so the characters have to outlive the dictionary
+    TermId InternExternal(std::string_view word);
+
+    TermId Find(std::string_view word) const;
+
+    std::string_view GetWord(TermId term_id) const;
+
+    size_t GetTermCount() const;
+
+private:
+    static constexpr size_t ARENA_BLOCK_SIZE = 64 * 1024;
+    // Chunk i of the word table holds FIRST_CHUNK_SIZE << i words, enough for every term id
+    static constexpr size_t FIRST_CHUNK_SIZE = 1024;
+    static constexpr size_t CHUNK_COUNT = 23;
+
+    // Open-addressing index of the words, at most half full. A slot holds the high half of
+    // the word's hash and the term id plus one, or zero if it is empty. When the index fills
+    // up, a copy twice the size replaces it and the old one is retired.
+    struct HashIndex {
+        explicit HashIndex(size_t capacity);
+
+        std::unique_ptr<std::atomic<uint64_t>[]> slots;
+        size_t mask;
+    };
+
+    std::vector<std::unique_ptr<char[]>> arena_blocks_;
+    char* current_block_ = nullptr;
+    size_t current_block_used_ = ARENA_BLOCK_SIZE;
+    std::array<std::atomic<std::string_view*>, CHUNK_COUNT> word_chunks_{};
+    std::atomic<size_t> term_count_{ 0 };
+    std::atomic<HashIndex*> index_;
+
+    std::string_view StoreWord(std::string_view word);
+
+    TermId AddWord(std::string_view word, bool is_external);
+
+    std::string_view& GetWordSlot(TermId term_id) const;
+
+    static void Insert(HashIndex& index, uint64_t hash, TermId term_id);
+
+    static uint64_t Hash(std::string_view word);
+};
\ No newline at end of file
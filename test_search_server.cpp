@@ -0,0 +1,901 @@
+#include "test_search_server.h"
+
+#include "process_queries.h"
+#include "query_arena.h"
+#include "scoring_kernel.h"
+#include "search_server.h"
+#include "stop_word_set.h"
+#include "string_processing.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <memory_resource>
+#include <optional>
+#include <random>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+using namespace std::literals;
+
+namespace {
+
+void AssertImpl(bool value, const char* expression, const char* file, int line) {
+    if (!value) {
+        std::cerr << file << ":" << line << ": ASSERT(" << expression << ") failed" << std::endl;
+        std::abort();
+    }
+}
+
+#define ASSERT(expr) AssertImpl(static_cast<bool>(expr), #expr, __FILE__, __LINE__)
+
+template <typename TestFunc>
+void RunTestImpl(TestFunc test, const char* test_name) {
+    test();
+    std::cerr << test_name << " OK" << std::endl;
+}
+
+#define RUN_TEST(func) RunTestImpl(func, #func)
+
+void TestZeroResultCount() {
+    SearchServer search_server("and"s);
+    search_server.AddDocument(1, "white cat and fancy collar"sv, DocumentStatus::ACTUAL, { 1 });
+    search_server.AddDocument(2, "fluffy cat fluffy tail"sv, DocumentStatus::ACTUAL, { 2 });
+
+    ASSERT(search_server.FindTopDocuments("fluffy cat"sv, DocumentStatus::ACTUAL, 0).empty());
+    ASSERT(search_server.FindTopDocuments(std::execution::par, "fluffy cat"sv, DocumentStatus::ACTUAL, 0).empty());
+    ASSERT(search_server.FindTopDocuments(search_policy::wand, "fluffy cat"sv, DocumentStatus::ACTUAL, 0).empty());
+    ASSERT(search_server.FindTopDocuments(search_policy::wand, "fluffy cat"sv, DocumentStatus::ACTUAL, 1).size() == 1);
+}
+
+void TestQueryArenaStaysBounded() {
+    QueryArena& arena = QueryArena::ForCurrentThread();
+    {
+        const QueryArena::Scope scope;
+        std::pmr::vector<char> scratch(16 * QueryArena::MAX_KEPT_SIZE, &arena);
+        ASSERT(arena.GetCapacity() >= scratch.size());
+    }
+    ASSERT(arena.GetCapacity() <= QueryArena::MAX_KEPT_SIZE);
+
+    SearchServer search_server("and"s);
+    search_server.AddDocument(1, "white cat and fancy collar"sv, DocumentStatus::ACTUAL, { 1 });
+    std::string query = "cat";
+    for (int i = 0; i < 300000; ++i) {
+        query += " w"s + std::to_string(i);
+    }
+    ASSERT(search_server.FindTopDocuments(query).size() == 1);
+    ASSERT(arena.GetCapacity() <= QueryArena::MAX_KEPT_SIZE);
+}
+
+void TestQueryCache() {
+    SearchServer search_server("and"s);
+    search_server.AddDocument(1, "white cat and fancy collar"sv, DocumentStatus::ACTUAL, { 1 });
+    search_server.AddDocument(2, "fluffy cat fluffy tail"sv, DocumentStatus::ACTUAL, { 2 });
+    search_server.EnableQueryCache(100);
+
+    const auto first = search_server.FindTopDocuments("fluffy cat"sv);
+    ASSERT(search_server.FindTopDocuments("fluffy cat"sv) == first);
+    // The cache key is the parsed query, so word order does not matter
+    ASSERT(search_server.FindTopDocuments("cat fluffy"sv) == first);
+    ASSERT(search_server.GetQueryCacheStats().hits == 2);
+    ASSERT(search_server.GetQueryCacheStats().misses == 1);
+
+    // Changes invalidate cached results
+    search_server.AddDocument(3, "fluffy dog"sv, DocumentStatus::ACTUAL, { 3 });
+    ASSERT(search_server.FindTopDocuments("fluffy cat"sv).size() == 3);
+    search_server.RemoveDocument(2);
+    ASSERT(search_server.FindTopDocuments("fluffy cat"sv).size() == 2);
+    ASSERT(search_server.GetQueryCacheStats().misses == 3);
+
+    search_server.DisableQueryCache();
+    ASSERT(search_server.FindTopDocuments("fluffy cat"sv).size() == 2);
+    ASSERT(search_server.GetQueryCacheStats().hits == 0);
+}
+
+// Queries keep using the cache they loaded while other threads replace or disable it
+void TestQueryCacheToggleDuringQueries() {
+    SearchServer search_server("and"s);
+    search_server.AddDocument(1, "white cat and fancy collar"sv, DocumentStatus::ACTUAL, { 1 });
+    search_server.AddDocument(2, "fluffy cat fluffy tail"sv, DocumentStatus::ACTUAL, { 2 });
+    const auto expected = search_server.FindTopDocuments("fluffy cat"sv);
+    std::atomic<bool> is_done = false;
+    std::vector<std::thread> readers;
+    for (int i = 0; i < 2; ++i) {
+        readers.emplace_back([&] {
+            while (!is_done) {
+                ASSERT(search_server.FindTopDocuments("fluffy cat"sv) == expected);
+                search_server.GetQueryCacheStats();
+            }
+            });
+    }
+    for (int i = 0; i < 2000; ++i) {
+        if (i % 3 == 2) {
+            search_server.DisableQueryCache();
+        }
+        else {
+            search_server.EnableQueryCache(10);
+        }
+    }
+    is_done = true;
+    for (std::thread& reader : readers) {
+        reader.join();
+    }
+}
+
+std::vector<int> GetDocumentIds(const std::vector<Document>& documents) {
+    std::vector<int> document_ids;
+    for (const Document& document : documents) {
+        document_ids.push_back(document.id);
+    }
+    std::sort(document_ids.begin(), document_ids.end());
+    return document_ids;
+}
+
+template <typename Func>
+bool Throws(Func func) {
+    try {
+        func();
+    }
+    catch (const std::invalid_argument&) {
+        return true;
+    }
+    return false;
+}
+
+void TestPhraseQueries() {
+    SearchServer search_server("and"s);
+    search_server.EnablePositionalIndex();
+    search_server.AddDocument(1, "fluffy white cat"sv, DocumentStatus::ACTUAL, { 1 });
+    search_server.AddDocument(2, "white fluffy cat"sv, DocumentStatus::ACTUAL, { 1 });
+    search_server.AddDocument(3, "fluffy and white cat"sv, DocumentStatus::ACTUAL, { 1 });
+    search_server.AddDocument(4, "fluffy big white cat"sv, DocumentStatus::ACTUAL, { 1 });
+    // Gives the phrase words a non-zero IDF, so phrase matches add to the relevance
+    search_server.AddDocument(5, "black dog"sv, DocumentStatus::ACTUAL, { 1 });
+
+    // Stop words do not count as positions
+    ASSERT(GetDocumentIds(search_server.FindTopDocuments("\"fluffy white\""sv)) == std::vector<int>({ 1, 3 }));
+    ASSERT(GetDocumentIds(search_server.FindTopDocuments("\"fluffy white\"~1"sv)) == std::vector<int>({ 1, 3, 4 }));
+    // Swapped neighbours need a slop of 2
+    const auto swapped = search_server.FindTopDocuments("\"fluffy white\"~2"sv);
+    ASSERT(GetDocumentIds(swapped) == std::vector<int>({ 1, 2, 3, 4 }));
+    const auto score_of = [&swapped](int document_id) {
+        return std::find_if(swapped.begin(), swapped.end(), [document_id](const Document& document) {
+            return document.id == document_id;
+            })->relevance;
+    };
+    ASSERT(score_of(1) > score_of(2));
+    ASSERT(std::get<0>(search_server.MatchDocument("\"fluffy white\" cat"sv, 2)).empty());
+    ASSERT(std::get<0>(search_server.MatchDocument("\"fluffy white\"~2 cat"sv, 2)).size() == 3);
+    ASSERT(search_server.FindTopDocuments("\"fluffy white\"~4294967295"sv).size() == 4);
+
+    for (std::string_view query : { "\"fluffy white\"~"sv, "\"fluffy white\"~x"sv, "\"fluffy white\"1"sv, "\"fluffy white\"~4294967296"sv }) {
+        ASSERT(Throws([&] { search_server.FindTopDocuments(query); }));
+    }
+}
+
+void TestWordFrequencies() {
+    SearchServer search_server("and"s);
+    search_server.AddDocument(1, "fluffy cat and fluffy tail"sv, DocumentStatus::ACTUAL, { 1 });
+    const auto word_frequencies = search_server.GetWordFrequencies(1);
+    ASSERT(word_frequencies.size() == 3);
+    ASSERT(std::abs(word_frequencies.at("fluffy"sv) - 0.5) < 1e-6);
+    ASSERT(std::abs(word_frequencies.at("cat"sv) - 0.25) < 1e-6);
+    ASSERT(search_server.GetWordFrequencies(2).empty());
+
+    // The result outlives the segment it was read from
+    search_server.RemoveDocument(1);
+    for (int i = 2; i < 100; ++i) {
+        search_server.AddDocument(i, "white dog"sv, DocumentStatus::ACTUAL, { 1 });
+    }
+    ASSERT(search_server.GetWordFrequencies(1).empty());
+    ASSERT(std::abs(word_frequencies.at("tail"sv) - 0.25) < 1e-6);
+}
+
+void TestParallelFor() {
+    ThreadPool thread_pool(3);
+    ASSERT(thread_pool.GetParallelism() >= 1 && thread_pool.GetParallelism() <= 4);
+
+    // Nested calls run on workers that wait for their own helpers
+    std::vector<std::atomic<int>> counts(1000);
+    thread_pool.ParallelFor(10, [&](size_t i) {
+        thread_pool.ParallelFor(100, [&](size_t j) {
+            ++counts[i * 100 + j];
+            });
+        });
+    ASSERT(std::all_of(counts.begin(), counts.end(), [](const std::atomic<int>& count) {
+        return count == 1;
+        }));
+
+    // The exception reaches the caller. With helpers every other index still runs; inline
+    // calls stop at the exception.
+    std::atomic<int> call_count = 0;
+    ASSERT(Throws([&] {
+        thread_pool.ParallelFor(100, [&](size_t i) {
+            ++call_count;
+            if (i == 50) {
+                throw std::invalid_argument("index 50");
+            }
+            });
+        }));
+    ASSERT(call_count == (thread_pool.GetParallelism() == 1 ? 51 : 100));
+}
+
+// Random documents over a small vocabulary, with every word repeated a random number of times
+std::vector<std::string> GenerateTexts(std::mt19937& generator, const std::vector<std::string>& words, int text_count, int max_word_count) {
+    std::vector<std::string> texts;
+    for (int i = 0; i < text_count; ++i) {
+        std::string text;
+        const int word_count = std::uniform_int_distribution(1, max_word_count)(generator);
+        for (int j = 0; j < word_count; ++j) {
+            text += words[std::uniform_int_distribution<size_t>(0, words.size() - 1)(generator)] + ' ';
+        }
+        texts.push_back(std::move(text));
+    }
+    return texts;
+}
+
+// Documents that tie on relevance and rating may come in any order, so only the ranks are compared
+bool HaveSameRanks(const std::vector<Document>& lhs, const std::vector<Document>& rhs) {
+    return std::equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(), [](const Document& lhs, const Document& rhs) {
+        return std::abs(lhs.relevance - rhs.relevance) < 1e-6 && lhs.rating == rhs.rating;
+        });
+}
+
+void TestWandMatchesSequential() {
+    std::mt19937 generator;
+    std::vector<std::string> words;
+    for (int i = 0; i < 60; ++i) {
+        words.push_back("w"s + std::to_string(i));
+    }
+    const auto texts = GenerateTexts(generator, words, 3000, 20);
+    SearchServer search_server("w0"s);
+    for (int i = 0; i < static_cast<int>(texts.size()); ++i) {
+        search_server.AddDocument(i, texts[i], static_cast<DocumentStatus>(i % 3), { i % 7, i % 5 });
+    }
+    for (int i = 0; i < static_cast<int>(texts.size()); i += 11) {
+        search_server.RemoveDocument(i);
+    }
+
+    // Queries longer than MAX_WAND_TERM_COUNT take the sequential fallback
+    for (const std::string& raw_query : GenerateTexts(generator, words, 200, static_cast<int>(2 * SearchServer::MAX_WAND_TERM_COUNT))) {
+        const std::string query = raw_query + " -" + words[std::uniform_int_distribution<size_t>(0, words.size() - 1)(generator)];
+        for (size_t result_count : { 1, 5, 50 }) {
+            for (DocumentStatus status : { DocumentStatus::ACTUAL, DocumentStatus::BANNED }) {
+                ASSERT(HaveSameRanks(search_server.FindTopDocuments(search_policy::wand, query, status, result_count),
+                    search_server.FindTopDocuments(std::execution::seq, query, status, result_count)));
+            }
+            const auto is_even = [](int document_id, DocumentStatus, int) {
+                return document_id % 2 == 0;
+            };
+            ASSERT(HaveSameRanks(search_server.FindTopDocuments(search_policy::wand, query, is_even, result_count),
+                search_server.FindTopDocuments(std::execution::seq, query, is_even, result_count)));
+        }
+    }
+}
+
+// Every eighth batch starts a background merge, and the removals that follow each batch
+// land while segments holding those documents are being merged
+void TestRemoveDuringMerges() {
+    static constexpr int BATCH_SIZE = 2000;
+    std::mt19937 generator;
+    std::vector<std::string> words;
+    for (int i = 0; i < 40; ++i) {
+        words.push_back("w"s + std::to_string(i));
+    }
+    const auto texts = GenerateTexts(generator, words, 16 * BATCH_SIZE, 20);
+    // Merges run on the pool, which has no workers on a single core machine
+    ThreadPool thread_pool(2);
+    SearchServer search_server("w0"s);
+    search_server.SetThreadPool(thread_pool);
+    std::set<int> removed_ids;
+    for (int batch_begin = 0; batch_begin < static_cast<int>(texts.size()); batch_begin += BATCH_SIZE) {
+        std::vector<std::tuple<int, std::string_view, DocumentStatus, std::vector<int>>> documents;
+        for (int i = batch_begin; i < batch_begin + BATCH_SIZE; ++i) {
+            documents.emplace_back(i, texts[i], static_cast<DocumentStatus>(i % 3), std::vector<int>{ i % 7 });
+        }
+        search_server.AddDocuments(documents);
+        for (int i = 0; i < 200; ++i) {
+            const int document_id = std::uniform_int_distribution(0, batch_begin + BATCH_SIZE - 1)(generator);
+            search_server.RemoveDocument(document_id);
+            removed_ids.insert(document_id);
+        }
+    }
+
+    SearchServer expected_server("w0"s);
+    std::vector<std::tuple<int, std::string_view, DocumentStatus, std::vector<int>>> live_documents;
+    for (int i = 0; i < static_cast<int>(texts.size()); ++i) {
+        if (removed_ids.count(i) == 0) {
+            live_documents.emplace_back(i, texts[i], static_cast<DocumentStatus>(i % 3), std::vector<int>{ i % 7 });
+        }
+    }
+    expected_server.AddDocuments(live_documents);
+    ASSERT(search_server.GetDocumentCount() == expected_server.GetDocumentCount());
+    ASSERT(std::equal(search_server.begin(), search_server.end(), expected_server.begin(), expected_server.end()));
+    for (const std::string& query : GenerateTexts(generator, words, 100, 5)) {
+        for (DocumentStatus status : { DocumentStatus::ACTUAL, DocumentStatus::IRRELEVANT, DocumentStatus::BANNED }) {
+            const auto expected = expected_server.FindTopDocuments(query, status);
+            ASSERT(HaveSameRanks(search_server.FindTopDocuments(std::execution::seq, query, status), expected));
+            ASSERT(HaveSameRanks(search_server.FindTopDocuments(std::execution::par, query, status), expected));
+            ASSERT(HaveSameRanks(search_server.FindTopDocuments(search_policy::wand, query, status), expected));
+        }
+    }
+}
+
+// Batches are cut into chunks by query count and by scratch size, and chunks are evaluated
+// in rounds of one chunk per task, so large batches cross all of those boundaries
+void TestBatchMatchesSingleQueries() {
+    std::mt19937 generator;
+    std::vector<std::string> words;
+    for (int i = 0; i < 1000; ++i) {
+        words.push_back("w"s + std::to_string(i));
+    }
+    const auto texts = GenerateTexts(generator, words, 10000, 100);
+    ThreadPool thread_pool(2);
+    SearchServer search_server("w0"s);
+    search_server.SetThreadPool(thread_pool);
+    std::vector<std::tuple<int, std::string_view, DocumentStatus, std::vector<int>>> documents;
+    for (int i = 0; i < static_cast<int>(texts.size()); ++i) {
+        documents.emplace_back(i, texts[i], static_cast<DocumentStatus>(i % 3), std::vector<int>{ i % 7 });
+    }
+    search_server.AddDocuments(documents);
+
+    std::vector<std::string> queries;
+    for (std::string query : GenerateTexts(generator, words, 1500, 6)) {
+        switch (queries.size() % 10) {
+        case 0:
+            query.clear();
+            break;
+        case 1:
+            query = "-" + words[std::uniform_int_distribution<size_t>(0, words.size() - 1)(generator)];
+            break;
+        case 2:
+            query += " +" + words[std::uniform_int_distribution<size_t>(0, words.size() - 1)(generator)];
+            break;
+        default:
+            query += " -" + words[std::uniform_int_distribution<size_t>(0, words.size() - 1)(generator)];
+        }
+        queries.push_back(std::move(query));
+    }
+    for (DocumentStatus status : { DocumentStatus::ACTUAL, DocumentStatus::BANNED }) {
+        const auto results = search_server.FindTopDocumentsBatch(queries, status);
+        ASSERT(results.size() == queries.size());
+        for (size_t i = 0; i < queries.size(); ++i) {
+            ASSERT(HaveSameRanks(results[i], search_server.FindTopDocuments(queries[i], status)));
+        }
+    }
+    ASSERT(search_server.FindTopDocumentsBatch({}).empty());
+}
+
+void TestSnapshotRoundTrip() {
+    std::mt19937 generator;
+    std::vector<std::string> words;
+    for (int i = 0; i < 40; ++i) {
+        words.push_back("w"s + std::to_string(i));
+    }
+    const auto texts = GenerateTexts(generator, words, 1000, 20);
+    SearchServer search_server("w0 w1"s);
+    search_server.EnablePositionalIndex();
+    for (int i = 0; i < static_cast<int>(texts.size()); ++i) {
+        search_server.AddDocument(i * 2, texts[i], static_cast<DocumentStatus>(i % 3), { i % 9 });
+    }
+    for (int i = 0; i < static_cast<int>(texts.size()); i += 7) {
+        search_server.RemoveDocument(i * 2);
+    }
+
+    const std::string path = (std::filesystem::temp_directory_path() / "test_search_server.snapshot").string();
+    search_server.Save(path);
+    {
+        SearchServer loaded = SearchServer::Load(path);
+        ASSERT(loaded.GetDocumentCount() == search_server.GetDocumentCount());
+        ASSERT(std::equal(loaded.begin(), loaded.end(), search_server.begin(), search_server.end()));
+        for (std::string query : GenerateTexts(generator, words, 100, 5)) {
+            query += " -" + words[std::uniform_int_distribution<size_t>(0, words.size() - 1)(generator)];
+            for (DocumentStatus status : { DocumentStatus::ACTUAL, DocumentStatus::IRRELEVANT }) {
+                ASSERT(HaveSameRanks(loaded.FindTopDocuments(query, status), search_server.FindTopDocuments(query, status)));
+            }
+        }
+        const std::string phrase_query = "\"" + words[2] + ' ' + words[3] + "\"~2";
+        ASSERT(HaveSameRanks(loaded.FindTopDocuments(phrase_query), search_server.FindTopDocuments(phrase_query)));
+        for (int document_id : { 2, 4, 500 }) {
+            ASSERT(loaded.MatchDocument(texts[document_id / 2], document_id) == search_server.MatchDocument(texts[document_id / 2], document_id));
+        }
+
+        // The loaded index keeps taking changes on top of the mapped segment
+        loaded.AddDocument(1, texts[2], DocumentStatus::ACTUAL, { 100 });
+        loaded.RemoveDocument(2);
+        ASSERT(loaded.GetDocumentCount() == search_server.GetDocumentCount());
+        const auto top_documents = loaded.FindTopDocuments(texts[1], DocumentStatus::IRRELEVANT);
+        ASSERT(std::none_of(top_documents.begin(), top_documents.end(), [](const Document& document) {
+            return document.id == 2;
+            }));
+        ASSERT(std::get<0>(loaded.MatchDocument(texts[2], 1)) == std::get<0>(search_server.MatchDocument(texts[2], 4)));
+
+        // Saving over the file the server has mapped must leave the mapping readable
+        const auto before_save = loaded.FindTopDocuments(texts[3]);
+        loaded.Save(path);
+        ASSERT(HaveSameRanks(loaded.FindTopDocuments(texts[3]), before_save));
+        ASSERT(std::get<0>(loaded.MatchDocument(texts[3], 6)) == std::get<0>(search_server.MatchDocument(texts[3], 6)));
+        ASSERT(!std::filesystem::exists(path + ".tmp"));
+        const SearchServer reloaded = SearchServer::Load(path);
+        ASSERT(reloaded.GetDocumentCount() == loaded.GetDocumentCount());
+        ASSERT(HaveSameRanks(reloaded.FindTopDocuments(texts[3]), before_save));
+    }
+    std::filesystem::remove(path);
+}
+
+void TestProcessQueriesJoined() {
+    std::mt19937 generator;
+    std::vector<std::string> words;
+    for (int i = 0; i < 40; ++i) {
+        words.push_back("w"s + std::to_string(i));
+    }
+    const auto texts = GenerateTexts(generator, words, 1000, 20);
+    ThreadPool thread_pool(2);
+    SearchServer search_server("w0"s);
+    search_server.SetThreadPool(thread_pool);
+    for (int i = 0; i < static_cast<int>(texts.size()); ++i) {
+        search_server.AddDocument(i, texts[i], DocumentStatus::ACTUAL, { i % 7 });
+    }
+
+    // Many more queries than the window of results kept ahead of the sink
+    auto queries = GenerateTexts(generator, words, 500, 5);
+    std::vector<Document> expected;
+    for (const auto& documents : ProcessQueries(search_server, queries)) {
+        expected.insert(expected.end(), documents.begin(), documents.end());
+    }
+    ASSERT(ProcessQueriesJoined(search_server, queries) == expected);
+    ASSERT(ProcessQueriesJoined(search_server, {}).empty());
+
+    // The sink gets every result before the failing query, then the error reaches the caller
+    const size_t invalid_query = 300;
+    queries[invalid_query] = "--w1"s;
+    size_t expected_count = 0;
+    for (size_t i = 0; i < invalid_query; ++i) {
+        expected_count += search_server.FindTopDocuments(queries[i]).size();
+    }
+    std::vector<Document> received;
+    ASSERT(Throws([&] {
+        ProcessQueriesJoined(search_server, queries, [&received](const Document& document) {
+            received.push_back(document);
+            });
+        }));
+    ASSERT(received.size() == expected_count);
+    ASSERT(std::equal(received.begin(), received.end(), expected.begin()));
+
+    // So do exceptions thrown by the sink
+    size_t sink_call_count = 0;
+    ASSERT(Throws([&] {
+        ProcessQueriesJoined(search_server, queries, [&sink_call_count](const Document&) {
+            if (++sink_call_count == 10) {
+                throw std::invalid_argument("sink");
+            }
+            });
+        }));
+    ASSERT(sink_call_count == 10);
+}
+
+void TestSplitIntoWords() {
+    const std::string text = "  fluffy  cat with a tail "s;
+    std::vector<std::string_view> words = { "stale"sv };
+    ASSERT(SplitIntoWords(text, words));
+    ASSERT(words == std::vector<std::string_view>({ "fluffy"sv, "cat"sv, "with"sv, "a"sv, "tail"sv }));
+    // The words are views into the text, not copies
+    ASSERT(words[0].data() == text.data() + 2);
+
+    // A reused buffer only holds the words of the last text
+    ASSERT(SplitIntoWords("dog"sv, words));
+    ASSERT(words == std::vector<std::string_view>({ "dog"sv }));
+    ASSERT(SplitIntoWords("   "sv, words));
+    ASSERT(words.empty());
+    ASSERT(!SplitIntoWords("fluffy\tcat"sv, words));
+    ASSERT(SplitIntoWords("fluffy cat"sv) == std::vector<std::string_view>({ "fluffy"sv, "cat"sv }));
+
+    SearchServer search_server("and"s);
+    ASSERT(Throws([&] { search_server.AddDocument(1, "fluffy c\x12t"sv, DocumentStatus::ACTUAL, { 1 }); }));
+    ASSERT(Throws([&] { search_server.FindTopDocuments("fluffy c\x12t"sv); }));
+    ASSERT(search_server.GetDocumentCount() == 0);
+}
+
+// Texts long enough for the 16 and 32 byte blocks of the vector paths and their tails,
+// checked against a byte by byte split
+void TestSplitIntoWordsMatchesScalar() {
+    std::mt19937 generator;
+    const std::string alphabet = "  ab\x7f\x80\xff"s;
+    std::vector<std::string_view> words;
+    for (int i = 0; i < 20000; ++i) {
+        std::string text(std::uniform_int_distribution(0, 100)(generator), ' ');
+        for (char& c : text) {
+            c = alphabet[std::uniform_int_distribution<size_t>(0, alphabet.size() - 1)(generator)];
+        }
+        if (i % 2 == 1 && !text.empty()) {
+            text[std::uniform_int_distribution<size_t>(0, text.size() - 1)(generator)] = static_cast<char>(std::uniform_int_distribution(0, 31)(generator));
+        }
+
+        std::vector<std::string_view> expected;
+        bool is_valid = true;
+        size_t word_begin = 0;
+        for (size_t j = 0; j <= text.size(); ++j) {
+            if (j < text.size() && static_cast<unsigned char>(text[j]) < ' ') {
+                is_valid = false;
+            }
+            if (j == text.size() || text[j] == ' ') {
+                if (j > word_begin) {
+                    expected.push_back(std::string_view(text).substr(word_begin, j - word_begin));
+                }
+                word_begin = j + 1;
+            }
+        }
+        ASSERT(SplitIntoWords(text, words) == is_valid);
+        ASSERT(words == expected);
+    }
+}
+
+void TestStopWordSet() {
+    const StopWordSet stop_words(MakeUniqueNonEmptyStrings(std::vector<std::string>{ "a"s, "and"s, "withstand"s, "internationalization"s }));
+    ASSERT(stop_words.size() == 4);
+    for (std::string_view word : { "a"sv, "and"sv, "withstand"sv, "internationalization"sv }) {
+        ASSERT(stop_words.Contains(word));
+    }
+    // Words that share the stored length and first eight bytes differ only after them
+    for (std::string_view word : { ""sv, "an"sv, "andy"sv, "withstanD"sv, "withstands"sv, "internationalisation"sv, "b"sv }) {
+        ASSERT(!stop_words.Contains(word));
+    }
+    ASSERT(!StopWordSet().Contains("and"sv));
+
+    // Enough words for long probe sequences
+    std::set<std::string, std::less<>> words;
+    for (int i = 0; i < 5000; ++i) {
+        words.insert("stopword"s + std::to_string(i));
+    }
+    const StopWordSet many_stop_words(words);
+    for (int i = 0; i < 5000; ++i) {
+        ASSERT(many_stop_words.Contains("stopword"s + std::to_string(i)));
+        ASSERT(!many_stop_words.Contains("stopword"s + std::to_string(i + 5000)));
+    }
+
+    SearchServer search_server("  and in  and the "s);
+    search_server.AddDocument(1, "cat in the city and"sv, DocumentStatus::ACTUAL, { 1 });
+    ASSERT(search_server.GetWordFrequencies(1).size() == 2);
+    ASSERT(search_server.FindTopDocuments("the"sv).empty());
+    ASSERT(search_server.FindTopDocuments("-the cat"sv).size() == 1);
+    ASSERT(std::get<0>(search_server.MatchDocument("in city"sv, 1)) == std::vector<std::string_view>({ "city"sv }));
+}
+
+void TestAddDocuments() {
+    std::mt19937 generator;
+    std::vector<std::string> words;
+    for (int i = 0; i < 40; ++i) {
+        words.push_back("w"s + std::to_string(i));
+    }
+    const auto texts = GenerateTexts(generator, words, 3000, 20);
+    ThreadPool thread_pool(2);
+    SearchServer search_server("w0"s);
+    search_server.SetThreadPool(thread_pool);
+    SearchServer expected_server("w0"s);
+    std::vector<std::tuple<int, std::string_view, DocumentStatus, std::vector<int>>> documents;
+    for (int i = 0; i < static_cast<int>(texts.size()); ++i) {
+        const DocumentStatus status = static_cast<DocumentStatus>(i % 3);
+        documents.emplace_back(i * 3, texts[i], status, std::vector<int>{ i % 7, i % 4 });
+        expected_server.AddDocument(i * 3, texts[i], status, { i % 7, i % 4 });
+    }
+    search_server.AddDocuments(documents);
+    ASSERT(search_server.GetDocumentCount() == expected_server.GetDocumentCount());
+    ASSERT(std::equal(search_server.begin(), search_server.end(), expected_server.begin(), expected_server.end()));
+    for (const std::string& query : GenerateTexts(generator, words, 100, 5)) {
+        for (DocumentStatus status : { DocumentStatus::ACTUAL, DocumentStatus::BANNED }) {
+            ASSERT(HaveSameRanks(search_server.FindTopDocuments(query, status), expected_server.FindTopDocuments(query, status)));
+        }
+    }
+    for (int document_id : { 0, 3, 1500 }) {
+        ASSERT(search_server.MatchDocument(texts[document_id / 3], document_id) == expected_server.MatchDocument(texts[document_id / 3], document_id));
+        ASSERT(search_server.GetWordFrequencies(document_id) == expected_server.GetWordFrequencies(document_id));
+    }
+
+    // A bad entry anywhere in the batch leaves the index unchanged
+    using Batch = std::vector<std::tuple<int, std::string_view, DocumentStatus, std::vector<int>>>;
+    const Batch bad_batches[] = {
+        { { 1, "fluffy cat"sv, DocumentStatus::ACTUAL, {} }, { 3, "fluffy dog"sv, DocumentStatus::ACTUAL, {} } },
+        { { 1, "fluffy cat"sv, DocumentStatus::ACTUAL, {} }, { 1, "fluffy dog"sv, DocumentStatus::ACTUAL, {} } },
+        { { 1, "fluffy cat"sv, DocumentStatus::ACTUAL, {} }, { -1, "fluffy dog"sv, DocumentStatus::ACTUAL, {} } },
+        { { 1, "fluffy cat"sv, DocumentStatus::ACTUAL, {} }, { 2, "fluffy d\x01g"sv, DocumentStatus::ACTUAL, {} } },
+    };
+    for (const Batch& batch : bad_batches) {
+        ASSERT(Throws([&] { search_server.AddDocuments(batch); }));
+        ASSERT(search_server.GetDocumentCount() == expected_server.GetDocumentCount());
+        ASSERT(search_server.FindTopDocuments("fluffy"sv).empty());
+    }
+    search_server.AddDocuments(Batch{});
+    ASSERT(search_server.GetDocumentCount() == expected_server.GetDocumentCount());
+}
+
+// The first batch of removals leaves the segment's postings in place behind its deletion
+// bitmap; the second removes most of its documents, which compacts it
+void TestRemoveDocuments() {
+    std::mt19937 generator;
+    std::vector<std::string> words;
+    for (int i = 0; i < 40; ++i) {
+        words.push_back("w"s + std::to_string(i));
+    }
+    const auto texts = GenerateTexts(generator, words, 2000, 20);
+    ThreadPool thread_pool(2);
+    SearchServer search_server("w0"s);
+    search_server.SetThreadPool(thread_pool);
+    std::vector<std::tuple<int, std::string_view, DocumentStatus, std::vector<int>>> documents;
+    for (int i = 0; i < static_cast<int>(texts.size()); ++i) {
+        documents.emplace_back(i, texts[i], static_cast<DocumentStatus>(i % 3), std::vector<int>{ i % 7 });
+    }
+    search_server.AddDocuments(documents);
+
+    std::set<int> removed_ids;
+    for (int removed_percent : { 40, 80 }) {
+        std::vector<int> document_ids = { -1, 5000 };
+        for (int i = 0; i < static_cast<int>(texts.size()); ++i) {
+            if (i * 7 % 100 < removed_percent) {
+                document_ids.push_back(i);
+                document_ids.push_back(i);
+                removed_ids.insert(i);
+            }
+        }
+        search_server.RemoveDocuments(document_ids);
+
+        SearchServer expected_server("w0"s);
+        for (int i = 0; i < static_cast<int>(texts.size()); ++i) {
+            if (removed_ids.count(i) == 0) {
+                expected_server.AddDocument(i, texts[i], static_cast<DocumentStatus>(i % 3), { i % 7 });
+            }
+        }
+        ASSERT(search_server.GetDocumentCount() == expected_server.GetDocumentCount());
+        ASSERT(std::equal(search_server.begin(), search_server.end(), expected_server.begin(), expected_server.end()));
+        for (const std::string& query : GenerateTexts(generator, words, 50, 5)) {
+            for (DocumentStatus status : { DocumentStatus::ACTUAL, DocumentStatus::BANNED }) {
+                const auto expected = expected_server.FindTopDocuments(query, status, 20);
+                ASSERT(HaveSameRanks(search_server.FindTopDocuments(std::execution::seq, query, status, 20), expected));
+                ASSERT(HaveSameRanks(search_server.FindTopDocuments(search_policy::wand, query, status, 20), expected));
+            }
+        }
+    }
+
+    const int removed_id = *removed_ids.begin();
+    bool is_out_of_range = false;
+    try {
+        search_server.MatchDocument(texts[removed_id], removed_id);
+    }
+    catch (const std::out_of_range&) {
+        is_out_of_range = true;
+    }
+    ASSERT(is_out_of_range);
+    ASSERT(search_server.GetWordFrequencies(removed_id).empty());
+
+    // A removed id may be used again
+    search_server.AddDocument(removed_id, "fluffy cat"sv, DocumentStatus::ACTUAL, { 1 });
+    ASSERT(GetDocumentIds(search_server.FindTopDocuments("fluffy"sv)) == std::vector<int>({ removed_id }));
+}
+
+void TestInverseDocumentFreqs() {
+    SearchServer search_server("and"s);
+    search_server.AddDocument(1, "cat and dog"sv, DocumentStatus::ACTUAL, { 1 });
+    search_server.AddDocument(2, "cat"sv, DocumentStatus::ACTUAL, { 2 });
+    search_server.AddDocument(3, "bird"sv, DocumentStatus::ACTUAL, { 3 });
+    const auto relevance_of = [&search_server](std::string_view query, int document_id) {
+        for (const Document& document : search_server.FindTopDocuments(query, DocumentStatus::ACTUAL, 100)) {
+            if (document.id == document_id) {
+                return document.relevance;
+            }
+        }
+        return -1.0;
+    };
+    ASSERT(std::abs(relevance_of("cat"sv, 2) - std::log(3.0 / 2)) < 1e-6);
+    ASSERT(std::abs(relevance_of("cat"sv, 1) - std::log(3.0 / 2) / 2) < 1e-6);
+
+    // Document frequencies follow removals and additions in later segments
+    search_server.RemoveDocument(3);
+    ASSERT(std::abs(relevance_of("cat"sv, 2)) < 1e-6);
+    search_server.AddDocument(4, "bird bird"sv, DocumentStatus::ACTUAL, { 4 });
+    search_server.AddDocument(5, "cat bird"sv, DocumentStatus::BANNED, { 5 });
+    ASSERT(std::abs(relevance_of("cat"sv, 2) - std::log(4.0 / 3)) < 1e-6);
+    ASSERT(std::abs(relevance_of("bird"sv, 4) - std::log(4.0 / 2)) < 1e-6);
+
+    // Terms past the first chunks of the table
+    std::string text;
+    for (int i = 0; i < 1000; ++i) {
+        text += "w"s + std::to_string(i) + ' ';
+    }
+    search_server.AddDocument(6, text, DocumentStatus::ACTUAL, { 6 });
+    search_server.AddDocument(7, "w999 w998"sv, DocumentStatus::ACTUAL, { 7 });
+    ASSERT(std::abs(relevance_of("w999"sv, 7) - std::log(6.0 / 2) / 2) < 1e-6);
+    search_server.RemoveDocuments(std::vector<int>{ 6, 1 });
+    ASSERT(std::abs(relevance_of("w999"sv, 7) - std::log(4.0 / 1) / 2) < 1e-6);
+    ASSERT(std::abs(relevance_of("cat"sv, 2) - std::log(4.0 / 2)) < 1e-6);
+    ASSERT(search_server.FindTopDocuments("w500"sv).empty());
+}
+
+// Block sizes below and across the vector width, with ordinals offset from the segment start
+void TestComputeTermScores() {
+    std::mt19937 generator;
+    const uint32_t first_ordinal = 1000;
+    std::vector<double> inv_word_counts(500);
+    for (size_t i = 0; i < inv_word_counts.size(); ++i) {
+        inv_word_counts[i] = 1.0 / std::uniform_int_distribution(1, 300)(generator);
+    }
+    for (size_t size = 0; size <= 40; ++size) {
+        std::vector<uint32_t> ordinals(size);
+        std::vector<uint32_t> counts(size);
+        for (size_t i = 0; i < size; ++i) {
+            ordinals[i] = first_ordinal + std::uniform_int_distribution<uint32_t>(0, static_cast<uint32_t>(inv_word_counts.size() - 1))(generator);
+            counts[i] = std::uniform_int_distribution<uint32_t>(1, 1000)(generator);
+        }
+        const double inverse_document_freq = std::log(std::uniform_real_distribution(1.0, 1000.0)(generator));
+        std::vector<double> scores(size + 1, -1.0);
+        ComputeTermScores(ordinals.data(), counts.data(), size, inv_word_counts.data(), first_ordinal, inverse_document_freq, scores.data());
+        for (size_t i = 0; i < size; ++i) {
+            ASSERT(scores[i] == counts[i] * inv_word_counts[ordinals[i] - first_ordinal] * inverse_document_freq);
+        }
+        ASSERT(scores[size] == -1.0);
+    }
+}
+
+// Segments reorder their documents by status, and merges append the columns of several
+// segments, so every predicate call must still see the fields of the right document
+void TestDocumentColumns() {
+    ThreadPool thread_pool(2);
+    SearchServer search_server("and"s);
+    search_server.SetThreadPool(thread_pool);
+    std::map<int, std::pair<DocumentStatus, int>> expected_fields;
+    std::vector<std::tuple<int, std::string_view, DocumentStatus, std::vector<int>>> documents;
+    for (int i = 0; i < 100; ++i) {
+        const DocumentStatus status = static_cast<DocumentStatus>((i * 7) % 4);
+        const std::vector<int> ratings = { i - 50, i % 3 - 9, 4 };
+        documents.emplace_back(i, "fluffy cat"sv, status, ratings);
+        expected_fields[i] = { status, (ratings[0] + ratings[1] + ratings[2]) / 3 };
+    }
+    search_server.AddDocuments(documents);
+    for (int i = 100; i < 120; ++i) {
+        const DocumentStatus status = static_cast<DocumentStatus>((i * 3) % 4);
+        search_server.AddDocument(i, "fluffy dog"sv, status, { -i });
+        expected_fields[i] = { status, -i };
+    }
+
+    std::map<int, std::pair<DocumentStatus, int>> seen_fields;
+    const auto documents_found = search_server.FindTopDocuments("fluffy"sv, [&](int document_id, DocumentStatus status, int rating) {
+        seen_fields[document_id] = { status, rating };
+        return true;
+        }, 1000);
+    ASSERT(seen_fields == expected_fields);
+    ASSERT(documents_found.size() == expected_fields.size());
+    for (const Document& document : documents_found) {
+        ASSERT(document.rating == expected_fields[document.id].second);
+    }
+    for (const auto& [document_id, fields] : expected_fields) {
+        ASSERT(std::get<1>(search_server.MatchDocument("fluffy"sv, document_id)) == fields.first);
+    }
+    ASSERT(search_server.FindTopDocuments("fluffy"sv, DocumentStatus::REMOVED, 1000).size() == 30);
+}
+
+void TestRequiredWords() {
+    SearchServer search_server("and"s);
+    search_server.AddDocument(1, "white cat and fancy collar"sv, DocumentStatus::ACTUAL, { 1 });
+    search_server.AddDocument(2, "fluffy cat fluffy tail"sv, DocumentStatus::ACTUAL, { 2 });
+    search_server.AddDocument(3, "groomed dog expressive eyes"sv, DocumentStatus::ACTUAL, { 3 });
+    search_server.AddDocument(4, "fluffy dog and white collar"sv, DocumentStatus::ACTUAL, { 4 });
+
+    ASSERT(GetDocumentIds(search_server.FindTopDocuments("+fluffy"sv)) == std::vector<int>({ 2, 4 }));
+    ASSERT(GetDocumentIds(search_server.FindTopDocuments("+fluffy cat collar"sv)) == std::vector<int>({ 2, 4 }));
+    ASSERT(GetDocumentIds(search_server.FindTopDocuments("+fluffy +collar"sv)) == std::vector<int>({ 4 }));
+    ASSERT(search_server.FindTopDocuments("+fluffy -collar"sv).size() == 1);
+    // An unknown required word matches nothing; a required stop word is ignored
+    ASSERT(search_server.FindTopDocuments("+fluffy +parrot"sv).empty());
+    ASSERT(search_server.FindTopDocuments("+and cat"sv).size() == 2);
+    ASSERT(std::get<0>(search_server.MatchDocument("+fluffy cat"sv, 1)).empty());
+    ASSERT(std::get<0>(search_server.MatchDocument("+fluffy cat"sv, 2)) == std::vector<std::string_view>({ "cat"sv, "fluffy"sv }));
+    ASSERT(Throws([&] { search_server.FindTopDocuments("+"sv); }));
+    ASSERT(Throws([&] { search_server.FindTopDocuments("+-cat"sv); }));
+
+    // Every policy returns exactly the documents that have all required words and no minus word
+    std::mt19937 generator;
+    std::vector<std::string> words;
+    for (int i = 0; i < 20; ++i) {
+        words.push_back("w"s + std::to_string(i));
+    }
+    const auto texts = GenerateTexts(generator, words, 2000, 10);
+    SearchServer random_server("w0"s);
+    std::vector<std::set<std::string>> text_words;
+    for (int i = 0; i < static_cast<int>(texts.size()); ++i) {
+        random_server.AddDocument(i, texts[i], DocumentStatus::ACTUAL, { i % 5 });
+        const auto split_words = SplitIntoWords(texts[i]);
+        text_words.emplace_back(split_words.begin(), split_words.end());
+    }
+    const auto pick_word = [&] {
+        return words[std::uniform_int_distribution<size_t>(1, words.size() - 1)(generator)];
+    };
+    for (int i = 0; i < 100; ++i) {
+        const std::string first_required = pick_word();
+        const std::string second_required = pick_word();
+        const std::string minus_word = pick_word();
+        const std::string query = pick_word() + " +" + first_required + " +" + second_required + " -" + minus_word;
+        std::vector<int> expected_ids;
+        for (int document_id = 0; document_id < static_cast<int>(texts.size()); ++document_id) {
+            const auto& document_words = text_words[document_id];
+            if (document_words.count(first_required) > 0 && document_words.count(second_required) > 0 && document_words.count(minus_word) == 0) {
+                expected_ids.push_back(document_id);
+            }
+        }
+        const auto expected = random_server.FindTopDocuments(std::execution::seq, query, DocumentStatus::ACTUAL, texts.size());
+        ASSERT(GetDocumentIds(expected) == expected_ids);
+        ASSERT(HaveSameRanks(random_server.FindTopDocuments(std::execution::par, query, DocumentStatus::ACTUAL, texts.size()), expected));
+        ASSERT(HaveSameRanks(random_server.FindTopDocuments(search_policy::wand, query, DocumentStatus::ACTUAL, texts.size()), expected));
+    }
+}
+
+void TestDocumentFilter() {
+    std::mt19937 generator;
+    std::vector<std::string> words;
+    for (int i = 0; i < 40; ++i) {
+        words.push_back("w"s + std::to_string(i));
+    }
+    const auto texts = GenerateTexts(generator, words, 3000, 20);
+    SearchServer search_server("w0"s);
+    for (int i = 0; i < static_cast<int>(texts.size()); ++i) {
+        search_server.AddDocument(i, texts[i], static_cast<DocumentStatus>(i % 4), { i % 11 - 5 });
+    }
+    for (int i = 0; i < static_cast<int>(texts.size()); i += 13) {
+        search_server.RemoveDocument(i);
+    }
+
+    std::vector<DocumentFilter> filters = { DocumentFilter{}, DocumentFilter{ DocumentStatus::IRRELEVANT } };
+    filters.push_back({ std::nullopt, -2, 3 });
+    filters.push_back({ DocumentStatus::BANNED, 0 });
+    filters.push_back({ DocumentStatus::ACTUAL, std::numeric_limits<int>::min(), -1 });
+    filters.push_back({ DocumentStatus::ACTUAL, 4, 2 });
+    for (const DocumentFilter& filter : filters) {
+        const auto predicate = [&filter](int, DocumentStatus status, int rating) {
+            return (!filter.status || status == *filter.status) && rating >= filter.min_rating && rating <= filter.max_rating;
+        };
+        for (const std::string& query : GenerateTexts(generator, words, 20, 4)) {
+            const auto expected = search_server.FindTopDocuments(std::execution::seq, query, predicate, 20);
+            ASSERT(HaveSameRanks(search_server.FindTopDocuments(query, filter, 20), expected));
+            ASSERT(HaveSameRanks(search_server.FindTopDocuments(std::execution::par, query, filter, 20), expected));
+            ASSERT(HaveSameRanks(search_server.FindTopDocuments(search_policy::wand, query, filter, 20), expected));
+            for (const Document& document : search_server.FindTopDocuments(query, filter, 20)) {
+                ASSERT(document.rating >= filter.min_rating && document.rating <= filter.max_rating);
+            }
+        }
+    }
+}
+
+}
+
+void TestSearchServer() {
+    RUN_TEST(TestZeroResultCount);
+    RUN_TEST(TestQueryArenaStaysBounded);
+    RUN_TEST(TestQueryCache);
+    RUN_TEST(TestQueryCacheToggleDuringQueries);
+    RUN_TEST(TestPhraseQueries);
+    RUN_TEST(TestWordFrequencies);
+    RUN_TEST(TestParallelFor);
+    RUN_TEST(TestWandMatchesSequential);
+    RUN_TEST(TestRemoveDuringMerges);
+    RUN_TEST(TestBatchMatchesSingleQueries);
+    RUN_TEST(TestSnapshotRoundTrip);
+    RUN_TEST(TestProcessQueriesJoined);
+    RUN_TEST(TestSplitIntoWords);
+    RUN_TEST(TestSplitIntoWordsMatchesScalar);
+    RUN_TEST(TestStopWordSet);
+    RUN_TEST(TestAddDocuments);
+    RUN_TEST(TestRemoveDocuments);
+    RUN_TEST(TestInverseDocumentFreqs);
+    RUN_TEST(TestComputeTermScores);
+    RUN_TEST(TestDocumentColumns);
+    RUN_TEST(TestRequiredWords);
+    RUN_TEST(TestDocumentFilter);
+}
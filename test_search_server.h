@@ -0,0 +1,4 @@
+#pragma once
+
+// Runs the SearchServer tests; prints the failed check and aborts on the first failure
+void TestSearchServer();
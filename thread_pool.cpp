@@ -0,0 +1,109 @@
+#include "thread_pool.h"
+
+namespace {
+
+thread_local const ThreadPool* current_pool = nullptr;
+thread_local size_t current_worker_index = 0;
+
+}
+
+ThreadPool::ThreadPool(size_t worker_count) {
+    const size_t hardware_thread_count = std::thread::hardware_concurrency();
+    max_helper_count_ = hardware_thread_count == 0 ? worker_count : std::min(worker_count, hardware_thread_count - 1);
+    queues_.reserve(worker_count);
+    for (size_t i = 0; i < worker_count; ++i) {
+        queues_.push_back(std::make_unique<TaskQueue>());
+    }
+    workers_.reserve(worker_count);
+    for (size_t i = 0; i < worker_count; ++i) {
+        workers_.emplace_back([this, i] { RunWorker(i); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard guard(sleep_mutex_);
+        stopping_ = true;
+    }
+    has_tasks_.notify_all();
+    for (auto& worker : workers_) {
+        worker.join();
+    }
+}
+
+size_t ThreadPool::GetWorkerCount() const {
+    return workers_.size();
+}
+
+size_t ThreadPool::GetParallelism() const {
+    return max_helper_count_ + 1;
+}
+
+void ThreadPool::Submit(std::function<void()> task) {
+    if (queues_.empty()) {
+        task();
+        return;
+    }
+    const size_t queue_index = current_pool == this
+        ? current_worker_index
+        : next_queue_++ % queues_.size();
+    ++pending_count_;
+    {
+        std::lock_guard guard(queues_[queue_index]->mutex);
+        queues_[queue_index]->tasks.push_back(std::move(task));
+    }
+    {
+        std::lock_guard guard(sleep_mutex_);
+    }
+    has_tasks_.notify_one();
+}
+
+ThreadPool& ThreadPool::GetDefault() {
+    static ThreadPool pool;
+    return pool;
+}
+
+bool ThreadPool::TryRunTask(size_t worker_index) {
+    std::function<void()> task;
+    {
+        TaskQueue& own_queue = *queues_[worker_index];
+        std::lock_guard guard(own_queue.mutex);
+        if (!own_queue.tasks.empty()) {
+            task = std::move(own_queue.tasks.back());
+            own_queue.tasks.pop_back();
+        }
+    }
+    for (size_t i = 1; !task && i < queues_.size(); ++i) {
+        TaskQueue& victim = *queues_[(worker_index + i) % queues_.size()];
+        std::lock_guard guard(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+        }
+    }
+    if (!task) {
+        return false;
+    }
+    --pending_count_;
+    task();
+    return true;
+}
+
+bool ThreadPool::TryRunTaskOnWorker() {
+    return current_pool == this && TryRunTask(current_worker_index);
+}
+
+void ThreadPool::RunWorker(size_t worker_index) {
+    current_pool = this;
+    current_worker_index = worker_index;
+    while (true) {
+        if (TryRunTask(worker_index)) {
+            continue;
+        }
+        std::unique_lock lock(sleep_mutex_);
+        has_tasks_.wait(lock, [this] { return stopping_ || pending_count_ > 0; });
+        if (stopping_ && pending_count_ == 0) {
+            return;
+        }
+    }
+}
\ No newline at end of file
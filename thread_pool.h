@@ -0,0 +1,122 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads that live as long as the pool. Every worker owns a task deque:
+// tasks submitted by a worker go to the back of its own deque and are taken from there first,
+// idle workers steal from the front of the others, and tasks from outside are dealt round-robin.
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t worker_count = std::thread::hardware_concurrency());
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    ~ThreadPool();
+
+    size_t GetWorkerCount() const;
+
+    // Number of threads a ParallelFor call runs on, the caller included. Workers beyond
+    // the hardware threads only serve Submit, so on a single core ParallelFor runs inline.
+    size_t GetParallelism() const;
+
+    void Submit(std::function<void()> task);
+
+    // Calls function(i) for every i in [0, count) and returns when all calls have finished.
+    // The calling thread takes part in the work, so ParallelFor may be nested inside tasks;
+    // a worker that waits for the other calls runs queued tasks meanwhile.
+    template <typename Function>
+    void ParallelFor(size_t count, Function function);
+
+    static ThreadPool& GetDefault();
+
+private:
+    struct TaskQueue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    std::vector<std::unique_ptr<TaskQueue>> queues_;
+    std::vector<std::thread> workers_;
+    size_t max_helper_count_ = 0;
+    std::atomic<size_t> pending_count_{ 0 };
+    std::atomic<size_t> next_queue_{ 0 };
+    std::mutex sleep_mutex_;
+    std::condition_variable has_tasks_;
+    bool stopping_ = false;
+
+    bool TryRunTask(size_t worker_index);
+
+    // Runs one queued task if the calling thread is a worker of this pool
+    bool TryRunTaskOnWorker();
+
+    void RunWorker(size_t worker_index);
+};
+
+template <typename Function>
+void ThreadPool::ParallelFor(size_t count, Function function) {
+    if (count == 0) {
+        return;
+    }
+    const size_t helper_count = std::min(count - 1, max_helper_count_);
+    if (helper_count == 0) {
+        for (size_t i = 0; i < count; ++i) {
+            function(i);
+        }
+        return;
+    }
+
+    struct State {
+        std::atomic<size_t> next_index{ 0 };
+        std::atomic<size_t> finished_count{ 0 };
+        std::mutex mutex;
+        std::condition_variable finished;
+        std::exception_ptr error;
+    };
+    const auto state = std::make_shared<State>();
+
+    // Helpers that start after every index is claimed return without touching function,
+    // which may be gone by then
+    const auto run = [state, count, &function] {
+        for (size_t i = state->next_index++; i < count; i = state->next_index++) {
+            try {
+                function(i);
+            }
+            catch (...) {
+                std::lock_guard guard(state->mutex);
+                if (!state->error) {
+                    state->error = std::current_exception();
+                }
+            }
+            if (++state->finished_count == count) {
+                std::lock_guard guard(state->mutex);
+                state->finished.notify_all();
+            }
+        }
+    };
+
+    for (size_t i = 0; i < helper_count; ++i) {
+        Submit(run);
+    }
+    run();
+
+    // Helpers nobody has started yet return at once, and a nested call's waiting worker
+    // would otherwise sit idle while its own deque holds work
+    while (state->finished_count != count && TryRunTaskOnWorker()) {
+    }
+    std::unique_lock lock(state->mutex);
+    state->finished.wait(lock, [&] { return state->finished_count == count; });
+    if (state->error) {
+        std::rethrow_exception(state->error);
+    }
+}
\ No newline at end of file
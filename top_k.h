@@ -0,0 +1,77 @@
+#pragma once
+
+#include <algorithm>
+#include <iterator>
+#include <memory_resource>
+#include <utility>
+#include <vector>
+
+// Keeps the max_count best items pushed so far. The kept items form a heap
+// whose front is the worst of them, so a rejected item costs one comparison.
+template <typename T, typename Compare>
+class TopKCollector {
+public:
+    explicit TopKCollector(size_t max_count, std::pmr::memory_resource* resource = std::pmr::get_default_resource(),
+        Compare is_better = Compare())
+        : max_count_(max_count)
+        , is_better_(std::move(is_better))
+        , heap_(resource) {
+    }
+
+    void Push(T item) {
+        if (heap_.size() < max_count_) {
+            heap_.push_back(std::move(item));
+            std::push_heap(heap_.begin(), heap_.end(), is_better_);
+        }
+        else if (max_count_ > 0 && is_better_(item, heap_.front())) {
+            std::pop_heap(heap_.begin(), heap_.end(), is_better_);
+            heap_.back() = std::move(item);
+            std::push_heap(heap_.begin(), heap_.end(), is_better_);
+        }
+    }
+
+    bool IsFull() const {
+        return heap_.size() == max_count_;
+    }
+
+    const T& GetWorst() const {
+        return heap_.front();
+    }
+
+    size_t GetMaxCount() const {
+        return max_count_;
+    }
+
+    // Drops the kept items and sets how many to keep from now on; the heap keeps its capacity
+    void Reset(size_t max_count) {
+        max_count_ = max_count;
+        heap_.clear();
+    }
+
+    size_t size() const {
+        return heap_.size();
+    }
+
+    // Returns the kept items, best first, and leaves the collector empty
+    std::vector<T> ExtractSorted() {
+        std::sort_heap(heap_.begin(), heap_.end(), is_better_);
+        std::vector<T> result(std::make_move_iterator(heap_.begin()), std::make_move_iterator(heap_.end()));
+        heap_.clear();
+        return result;
+    }
+
+    // Calls callback(item) for the kept items, best first, and leaves the collector empty
+    template <typename Callback>
+    void ExtractSorted(Callback callback) {
+        std::sort_heap(heap_.begin(), heap_.end(), is_better_);
+        for (T& item : heap_) {
+            callback(std::move(item));
+        }
+        heap_.clear();
+    }
+
+private:
+    size_t max_count_;
+    Compare is_better_;
+    std::pmr::vector<T> heap_;
+};
\ No newline at end of file